@@ -0,0 +1,114 @@
+//
+// CheckDispatchVisitor.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "CheckDispatchVisitor.h"
+#include "KeyPathValidationConsumer.h"
+
+using namespace clang;
+
+
+bool CheckDispatchVisitor::TraverseDecl(Decl *D) {
+  // Past its budget, the consumer may want nothing more
+  if (Consumer && Consumer->isOutOfBudget())
+    return false;
+  if (D && Filter) {
+    if (!Filter->shouldTraverseTopLevelDecl(D))
+      return true;
+    if (!Filter->overlapsChangedLines(D)) {
+      if (Stats)
+        ++Stats->DeclsOutsideChangedLines;
+      return true;
+    }
+  }
+  // A block or nested function defined in a loop body doesn't run there
+  unsigned OuterLoopDepth = LoopDepth;
+  if (D && (isa<BlockDecl>(D) || isa<FunctionDecl>(D) || isa<ObjCMethodDecl>(D)))
+    LoopDepth = 0;
+  // Blocks are named for where they're written
+  const Decl *OuterContainer = Container;
+  if (D && (isa<FunctionDecl>(D) || isa<ObjCMethodDecl>(D) || isa<ObjCContainerDecl>(D)))
+    Container = D;
+  bool Result = RecursiveASTVisitor<CheckDispatchVisitor>::TraverseDecl(D);
+  LoopDepth = OuterLoopDepth;
+  Container = OuterContainer;
+  return Result;
+}
+
+// Everything but the initializer of a for loop, and the collection of a
+// for-in loop, is evaluated on every iteration.
+bool CheckDispatchVisitor::TraverseForStmt(ForStmt *S) {
+  if (!TraverseStmt(S->getInit()))
+    return false;
+  ++LoopDepth;
+  bool Result = TraverseDecl(S->getConditionVariable()) && TraverseStmt(S->getCond()) && TraverseStmt(S->getInc()) && TraverseStmt(S->getBody());
+  --LoopDepth;
+  return Result;
+}
+
+bool CheckDispatchVisitor::TraverseWhileStmt(WhileStmt *S) {
+  ++LoopDepth;
+  bool Result = TraverseDecl(S->getConditionVariable()) && TraverseStmt(S->getCond()) && TraverseStmt(S->getBody());
+  --LoopDepth;
+  return Result;
+}
+
+bool CheckDispatchVisitor::TraverseDoStmt(DoStmt *S) {
+  ++LoopDepth;
+  bool Result = TraverseStmt(S->getBody()) && TraverseStmt(S->getCond());
+  --LoopDepth;
+  return Result;
+}
+
+bool CheckDispatchVisitor::TraverseObjCForCollectionStmt(ObjCForCollectionStmt *S) {
+  if (!TraverseStmt(S->getElement()) || !TraverseStmt(S->getCollection()))
+    return false;
+  ++LoopDepth;
+  bool Result = TraverseStmt(S->getBody());
+  --LoopDepth;
+  return Result;
+}
+
+bool CheckDispatchVisitor::VisitObjCMessageExpr(ObjCMessageExpr *E) {
+  if (Stats)
+    ++Stats->MessageSendsInspected;
+  for (size_t I = 0, N = Checks.size(); I != N; ++I)
+    runCheck(I, E, NULL, Container, LoopDepth > 0);
+  return true;
+}
+
+bool CheckDispatchVisitor::VisitObjCMethodDecl(ObjCMethodDecl *D) {
+  for (size_t I = 0, N = Checks.size(); I != N; ++I)
+    runCheck(I, NULL, D, D, false);
+  return true;
+}
+
+void CheckDispatchVisitor::runCheck(size_t Check, ObjCMessageExpr *Send, ObjCMethodDecl *Method, const Decl *Container, bool InLoop) {
+  StatsTimer::Region Timing(CheckTimers ? &CheckTimers[Check] : NULL);
+  if (Consumer)
+    Consumer->beginCheckVisit(Checks[Check], Send, Container, InLoop);
+  if (Send)
+    Checks[Check]->VisitObjCMessageExpr(Send);
+  else
+    Checks[Check]->VisitObjCMethodDecl(Method);
+  if (Consumer && Consumer->endCheckVisit()) {
+    DeferredVisit Visit = { Check, Send, Method, Container, InLoop, Consumer->invalidKeyDeferredOverBudget() };
+    Deferred.push_back(Visit);
+    if (Stats)
+      ++Stats->VisitsDeferred;
+  }
+}
+
+void CheckDispatchVisitor::replayDeferredVisits() {
+  std::vector<DeferredVisit> Visits;
+  Visits.swap(Deferred);
+  for (std::vector<DeferredVisit>::const_iterator I = Visits.begin(), E = Visits.end(); I != E; ++I) {
+    Consumer->beginReplayedVisit(I->OverBudget);
+    runCheck(I->Check, I->Send, I->Method, I->Container, I->InLoop);
+  }
+  if (Consumer)
+    Consumer->endReplay();
+}
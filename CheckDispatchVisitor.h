@@ -0,0 +1,80 @@
+//
+// CheckDispatchVisitor.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_CHECK_DISPATCH_VISITOR_H
+#define CLANG_KPV_CHECK_DISPATCH_VISITOR_H
+
+#include "KeyPathValidationCheck.h"
+#include "KeyPathValidationStats.h"
+#include "TraversalFilter.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "llvm/ADT/ArrayRef.h"
+#include <vector>
+
+using namespace clang;
+
+class KeyPathValidationConsumer;
+
+
+class CheckDispatchVisitor : public RecursiveASTVisitor<CheckDispatchVisitor> {
+  ArrayRef<KeyPathValidationCheck *> Checks;
+  TraversalFilter *Filter;
+  KeyPathValidationStats *Stats;
+  StatsTimer *CheckTimers;
+
+  // Loops enclosing the node being visited, counting only the parts that
+  // run on every iteration
+  unsigned LoopDepth;
+  // The innermost function, method or Objective-C container being traversed
+  const Decl *Container;
+
+  // Visits held back in streaming mode, to run again once the TU is complete
+  struct DeferredVisit {
+    size_t Check;
+    ObjCMessageExpr *Send;
+    ObjCMethodDecl *Method;
+    const Decl *Container;
+    bool InLoop;
+    bool OverBudget;
+  };
+  KeyPathValidationConsumer *Consumer;
+  std::vector<DeferredVisit> Deferred;
+
+  void runCheck(size_t Check, ObjCMessageExpr *Send, ObjCMethodDecl *Method, const Decl *Container, bool InLoop);
+
+public:
+  // CheckTimers, if given, has one timer per check. Consumer, if given, is
+  // told which check is running on what; visits in which it held back an
+  // invalid key are remembered, and run again by replayDeferredVisits().
+  CheckDispatchVisitor(ArrayRef<KeyPathValidationCheck *> Checks, TraversalFilter *Filter = NULL,
+                       KeyPathValidationStats *Stats = NULL, StatsTimer *CheckTimers = NULL,
+                       KeyPathValidationConsumer *Consumer = NULL)
+    : Checks(Checks)
+    , Filter(Filter)
+    , Stats(Stats)
+    , CheckTimers(CheckTimers)
+    , LoopDepth(0)
+    , Container(NULL)
+    , Consumer(Consumer)
+  { }
+
+  void replayDeferredVisits();
+
+  bool shouldVisitTemplateInstantiations() const { return false; }
+  bool shouldWalkTypesOfTypeLocs() const { return false; }
+
+  bool TraverseDecl(Decl *D);
+  bool TraverseForStmt(ForStmt *S);
+  bool TraverseWhileStmt(WhileStmt *S);
+  bool TraverseDoStmt(DoStmt *S);
+  bool TraverseObjCForCollectionStmt(ObjCForCollectionStmt *S);
+
+  bool VisitObjCMessageExpr(ObjCMessageExpr *E);
+  bool VisitObjCMethodDecl(ObjCMethodDecl *D);
+};
+
+#endif
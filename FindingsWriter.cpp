@@ -0,0 +1,153 @@
+//
+// FindingsWriter.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "FindingsWriter.h"
+#include "JSONOutput.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+
+
+FindingsWriter *FindingsWriter::create(StringRef Path, Format F, std::string &Error) {
+  llvm::OwningPtr<llvm::raw_fd_ostream> OS(new llvm::raw_fd_ostream(Path.str().c_str(), Error, llvm::sys::fs::F_None));
+  if (!Error.empty())
+    return NULL;
+  return new FindingsWriter(OS.take(), F);
+}
+
+
+FindingsWriter::FindingsWriter(llvm::raw_fd_ostream *OS, Format F)
+  : OS(OS)
+  , OutputFormat(F)
+  , Count(0)
+{
+  if (OutputFormat != FF_SARIF)
+    return;
+  *OS << "{\n"
+    << "  \"$schema\": \"https://json.schemastore.org/sarif-2.1.0.json\",\n"
+    << "  \"version\": \"2.1.0\",\n"
+    << "  \"runs\": [{\n"
+    << "    \"tool\": {\"driver\": {\"name\": \"validate-key-paths\", \"rules\": [\n"
+    << "      {\"id\": \"invalid-key\", \"shortDescription\": {\"text\": \"Key not found on the type it's looked up on\"}},\n"
+    << "      {\"id\": \"to-many-key-path\", \"shortDescription\": {\"text\": \"Key path evaluated for every element of a to-many relationship\"}},\n"
+    << "      {\"id\": \"kvc-in-loop\", \"shortDescription\": {\"text\": \"Keys looked up by name on every iteration of a loop\"}},\n"
+    << "      {\"id\": \"affecting-key-path\", \"shortDescription\": {\"text\": \"Key path returned by +keyPathsForValuesAffecting<Key>\"}}\n"
+    << "    ]}},\n"
+    << "    \"results\": [";
+  OS->flush();
+}
+
+
+bool FindingsWriter::finish() {
+  if (OutputFormat == FF_SARIF)
+    *OS << (Count ? "\n    ]\n" : "]\n") << "  }]\n}\n";
+  OS->flush();
+  bool Failed = OS->has_error();
+  OS->clear_error();
+  return !Failed;
+}
+
+
+// Deliberately leaves out the translation unit, and anything about the
+// compile, so findings in shared headers match up. The line and column are
+// left out too; the enclosing declaration and the key's offset in the key
+// path place the finding instead. Identical findings in one declaration are
+// told apart by Occurrence, which counts them in the order they're made; the
+// first keeps the plain fingerprint.
+std::string FindingsWriter::getFingerprint(const Finding &F, unsigned Occurrence) {
+  llvm::MD5 Hash;
+  StringRef Fields[] = { F.Kind, F.Check, F.Selector, F.File, F.Container, F.KeyPath, F.Key, F.ReceiverType };
+  for (size_t I = 0; I != sizeof(Fields) / sizeof(Fields[0]); ++I) {
+    Hash.update(Fields[I]);
+    Hash.update(StringRef("", 1));
+  }
+  llvm::SmallString<16> KeyOffset;
+  llvm::Twine(F.KeyOffset).toVector(KeyOffset);
+  Hash.update(KeyOffset);
+  if (Occurrence) {
+    llvm::SmallString<16> Nth("#");
+    llvm::Twine(Occurrence).toVector(Nth);
+    Hash.update(Nth);
+  }
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  llvm::SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+  return Digest.str();
+}
+
+
+void FindingsWriter::add(const Finding &F) {
+  std::string Fingerprint = getFingerprint(F);
+  // A check run again reports the same finding at the same place
+  llvm::SmallString<64> Place(Fingerprint);
+  (llvm::Twine(':') + llvm::Twine(F.Line) + ":" + llvm::Twine(F.Column)).toVector(Place);
+  if (!Written.insert(Place))
+    return;
+  if (unsigned Occurrence = Occurrences[Fingerprint]++)
+    Fingerprint = getFingerprint(F, Occurrence);
+  if (OutputFormat == FF_SARIF)
+    addSARIFResult(F, Fingerprint);
+  else
+    addJSONLine(F, Fingerprint);
+  ++Count;
+  // Streamed, so a tool can follow the file while the compile runs
+  OS->flush();
+}
+
+
+void FindingsWriter::addJSONLine(const Finding &F, StringRef Fingerprint) {
+  *OS << "{\"kind\": ";
+  printJSONString(*OS, F.Kind);
+  *OS << ", \"check\": ";
+  printJSONString(*OS, F.Check);
+  *OS << ", \"selector\": ";
+  printJSONString(*OS, F.Selector);
+  *OS << ", \"file\": ";
+  printJSONString(*OS, F.File);
+  *OS << ", \"line\": " << F.Line << ", \"column\": " << F.Column << ", \"key_path\": ";
+  printJSONString(*OS, F.KeyPath);
+  *OS << ", \"key\": ";
+  printJSONString(*OS, F.Key);
+  *OS << ", \"key_offset\": " << F.KeyOffset << ", \"receiver_type\": ";
+  printJSONString(*OS, F.ReceiverType);
+  *OS << ", \"container\": ";
+  printJSONString(*OS, F.Container);
+  *OS << ", \"message\": ";
+  printJSONString(*OS, F.Message);
+  *OS << ", \"fingerprint\": ";
+  printJSONString(*OS, Fingerprint);
+  *OS << "}\n";
+}
+
+
+void FindingsWriter::addSARIFResult(const Finding &F, StringRef Fingerprint) {
+  *OS << (Count ? ",\n      " : "\n      ") << "{\"ruleId\": ";
+  printJSONString(*OS, F.Kind);
+  *OS << ", \"level\": " << (F.Kind != "affecting-key-path" ? "\"warning\"" : "\"note\"") << ", \"message\": {\"text\": ";
+  printJSONString(*OS, F.Message);
+  *OS << "},\n       \"locations\": [{\"physicalLocation\": {\"artifactLocation\": {\"uri\": ";
+  printJSONString(*OS, F.File);
+  *OS << "}, \"region\": {\"startLine\": " << F.Line << ", \"startColumn\": " << F.Column << "}}}],\n"
+    << "       \"partialFingerprints\": {\"validateKeyPaths/v2\": ";
+  printJSONString(*OS, Fingerprint);
+  *OS << "},\n       \"properties\": {\"check\": ";
+  printJSONString(*OS, F.Check);
+  *OS << ", \"selector\": ";
+  printJSONString(*OS, F.Selector);
+  *OS << ", \"keyPath\": ";
+  printJSONString(*OS, F.KeyPath);
+  *OS << ", \"key\": ";
+  printJSONString(*OS, F.Key);
+  *OS << ", \"keyOffset\": " << F.KeyOffset << ", \"receiverType\": ";
+  printJSONString(*OS, F.ReceiverType);
+  *OS << ", \"container\": ";
+  printJSONString(*OS, F.Container);
+  *OS << "}}";
+}
@@ -0,0 +1,75 @@
+//
+// FindingsWriter.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_FINDINGS_WRITER_H
+#define CLANG_KPV_FINDINGS_WRITER_H
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+
+using llvm::StringRef;
+
+
+// Streams findings for one translation unit as they're made, either as JSON
+// Lines (one object per line) or as a SARIF 2.1.0 log, for tools that would
+// otherwise scrape clang's output. Each finding carries a fingerprint that
+// depends only on what was found and in which declaration, not on its line,
+// so the same finding from a header included by several translation units
+// can be merged away (utils/merge_findings.py does that), and a finding
+// keeps its fingerprint when code above it is edited. Identical findings in
+// one declaration are numbered, so they keep separate fingerprints.
+class FindingsWriter {
+public:
+  enum Format {
+    FF_JSONLines,
+    FF_SARIF
+  };
+
+  struct Finding {
+    Finding() : Line(0), Column(0), KeyOffset(0) { }
+
+    StringRef Kind;         // "invalid-key"; "to-many-key-path" or "kvc-in-loop" with perf;
+                            // or "affecting-key-path" for information
+    StringRef Check;        // KeyPathValidationCheck::getName()
+    StringRef Selector;     // of the message send, if any
+    StringRef File;
+    unsigned Line, Column;
+    StringRef KeyPath;
+    StringRef Key;          // the failing key
+    size_t KeyOffset;       // of Key in KeyPath
+    StringRef ReceiverType; // that Key was looked up on
+    StringRef Container;    // the function, method or class it's in, if any
+    StringRef Message;
+  };
+
+  // "-" writes to stdout. Returns NULL and sets Error if Path can't be opened.
+  static FindingsWriter *create(StringRef Path, Format F, std::string &Error);
+  // Findings already written for this TU, at the same line and column, are
+  // skipped.
+  void add(const Finding &F);
+  // Completes the document (SARIF needs closing); false if writing failed.
+  bool finish();
+
+  static std::string getFingerprint(const Finding &F, unsigned Occurrence = 0);
+
+private:
+  llvm::OwningPtr<llvm::raw_fd_ostream> OS;
+  Format OutputFormat;
+  unsigned Count;
+  llvm::StringSet<> Written;            // fingerprint:line:column
+  llvm::StringMap<unsigned> Occurrences; // by plain fingerprint
+
+  FindingsWriter(llvm::raw_fd_ostream *OS, Format F);
+  void addJSONLine(const Finding &F, StringRef Fingerprint);
+  void addSARIFResult(const Finding &F, StringRef Fingerprint);
+};
+
+#endif
@@ -0,0 +1,36 @@
+//
+// JSONOutput.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_JSON_OUTPUT_H
+#define CLANG_KPV_JSON_OUTPUT_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+
+// Writes S as a quoted JSON string.
+inline void printJSONString(llvm::raw_ostream &OS, llvm::StringRef S) {
+  OS << '"';
+  for (llvm::StringRef::iterator C = S.begin(), CEnd = S.end(); C != CEnd; ++C) {
+    switch (*C) {
+    case '"': OS << "\\\""; break;
+    case '\\': OS << "\\\\"; break;
+    case '\n': OS << "\\n"; break;
+    case '\r': OS << "\\r"; break;
+    case '\t': OS << "\\t"; break;
+    default:
+      if ((unsigned char)*C < 0x20)
+        OS << llvm::format("\\u%04x", (unsigned)(unsigned char)*C);
+      else
+        OS << *C;
+    }
+  }
+  OS << '"';
+}
+
+#endif
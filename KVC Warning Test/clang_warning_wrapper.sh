@@ -2,21 +2,17 @@
 
 IFS=
 
-clang $@
-STATUS=$?
-
 # When clang is built for Release:
 #CUSTOM_CLANG_ROOT=${CUSTOM_CLANG_ROOT:-$(dirname $0)/../../../../../Release}
 
 # For easy trying:
 CUSTOM_CLANG_ROOT=${CUSTOM_CLANG_ROOT:-$HOME/Downloads/kvc-clang-rel34-2014-05-17}
 
-if test "$STATUS" -eq 0 && test -d $CUSTOM_CLANG_ROOT && ! ( echo $@ | grep -wF -- -filelist ); then
-	# Xcode uses --serialize-diagnostics, which writes diagnostics to a file, overwriting the previous contents.
-	# Emit our additional diagnostics after the original has run.
+if test -d $CUSTOM_CLANG_ROOT && ! ( echo $@ | grep -qwF -- -filelist ); then
+	# The plug-in is added alongside the normal compile (-add-plugin rather than -plugin), so each file
+	# is parsed once and its diagnostics go into the --serialize-diagnostics file along with clang's own.
 	DISABLE_BAD_WARNINGS_IN_CUSTOM_CLANG=-Wno-unused-property-ivar
-	$CUSTOM_CLANG_ROOT/bin/clang -Xclang -load -Xclang $CUSTOM_CLANG_ROOT/lib/libKeyPathValidator.dylib -Xclang -plugin -Xclang validate-key-paths -fsyntax-only -Qunused-arguments $@ $DISABLE_BAD_WARNINGS_IN_CUSTOM_CLANG
-	STATUS=$?
+	exec $CUSTOM_CLANG_ROOT/bin/clang -Xclang -load -Xclang $CUSTOM_CLANG_ROOT/lib/libKeyPathValidator.dylib -Xclang -add-plugin -Xclang validate-key-paths -Qunused-arguments $@ $DISABLE_BAD_WARNINGS_IN_CUSTOM_CLANG
 fi
 
-exit $STATUS
+exec clang $@
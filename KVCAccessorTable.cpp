@@ -0,0 +1,153 @@
+//
+// KVCAccessorTable.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KVCAccessorTable.h"
+#include "clang/Basic/CharInfo.h"
+#include "llvm/ADT/SmallString.h"
+
+using namespace clang;
+
+
+static bool isUppercaseAt(StringRef Name, size_t Index) {
+  return Index < Name.size() && isUppercase(Name[Index]);
+}
+
+
+const KVCAccessorTable::Entry *KVCAccessorTable::lookup(StringRef Key, bool AllowPrivate) const {
+  llvm::StringMap<Slot>::const_iterator Found = Keys.find(Key);
+  if (Found == Keys.end())
+    return NULL;
+
+  const Entry &E = AllowPrivate ? Found->second.Any : Found->second.Public;
+  if (E.Kind == AK_None)
+    return NULL;
+  return &E;
+}
+
+
+// Entries already present win ties, so merge the most specific tables first.
+void KVCAccessorTable::mergeFrom(const KVCAccessorTable &Other) {
+  for (llvm::StringMap<Slot>::const_iterator Key = Other.Keys.begin(), KeyEnd = Other.Keys.end();
+      Key != KeyEnd; ++Key) {
+    Slot &S = Keys[Key->getKey()];
+    if (Key->second.Any.Kind < S.Any.Kind)
+      S.Any = Key->second.Any;
+    if (Key->second.Public.Kind < S.Public.Kind)
+      S.Public = Key->second.Public;
+  }
+
+  for (llvm::StringMap<CollectionParts>::const_iterator Collection = Other.Collections.begin(), CollectionEnd = Other.Collections.end();
+      Collection != CollectionEnd; ++Collection) {
+    CollectionParts &Parts = Collections[Collection->getKey()];
+    Parts.Public |= Collection->second.Public;
+    Parts.Any |= Collection->second.Any;
+  }
+}
+
+
+void KVCAccessorTable::addMethod(const ObjCMethodDecl *Method, bool Private) {
+  if (!Method->isInstanceMethod())
+    return;
+
+  Selector Sel = Method->getSelector();
+  StringRef Name = Sel.getNameForSlot(0);
+  QualType Type = Method->getResultType();
+
+  if (Sel.getNumArgs() == 0) {
+    addEntry(Name, AK_Key, Type, Private);
+    if (Name.startswith("get") && isUppercaseAt(Name, 3))
+      addCapitalizedEntry(Name.substr(3), AK_GetKey, Type, Private);
+    if (Name.startswith("is") && isUppercaseAt(Name, 2))
+      addCapitalizedEntry(Name.substr(2), AK_IsKey, Type, Private);
+    if (Name.startswith("countOf") && Name.size() > 7)
+      addCollectionPart(Name.substr(7), CP_CountOf, Private);
+    if (Name.startswith("enumeratorOf") && Name.size() > 12)
+      addCollectionPart(Name.substr(12), CP_EnumeratorOf, Private);
+
+  } else if (Sel.getNumArgs() == 1) {
+    if (Name.startswith("objectIn") && Name.endswith("AtIndex") && Name.size() > 15) {
+      addCollectionPart(Name.slice(8, Name.size() - 7), CP_ObjectInAtIndex, Private);
+    } else if (Name.endswith("AtIndexes") && Name.size() > 9) {
+      SmallString<64> CapitalizedKey(Name.drop_back(9));
+      CapitalizedKey[0] = toUppercase(CapitalizedKey[0]);
+      addCollectionPart(CapitalizedKey, CP_AtIndexes, Private);
+    }
+    if (Name.startswith("memberOf") && Name.size() > 8)
+      addCollectionPart(Name.substr(8), CP_MemberOf, Private);
+  }
+}
+
+
+void KVCAccessorTable::addIvar(const ObjCIvarDecl *Ivar, bool Private) {
+  StringRef Name = Ivar->getName();
+  QualType Type = Ivar->getType();
+
+  if (Name.startswith("_"))
+    Name = Name.substr(1);
+  if (Name.empty())
+    return;
+
+  addEntry(Name, AK_Ivar, Type, Private);
+  if (Name.startswith("is") && isUppercaseAt(Name, 2))
+    addCapitalizedEntry(Name.substr(2), AK_Ivar, Type, Private);
+}
+
+
+void KVCAccessorTable::addCollectionProperty(const ObjCPropertyDecl *Property) {
+  addEntry(Property->getName(), AK_CollectionProperty, Property->getType(), false);
+}
+
+
+void KVCAccessorTable::addCollectionAccessors(QualType OrderedProxyType, QualType UnorderedProxyType) {
+  for (llvm::StringMap<CollectionParts>::const_iterator Collection = Collections.begin(), CollectionEnd = Collections.end();
+      Collection != CollectionEnd; ++Collection) {
+    for (int Private = 0; Private <= 1; ++Private) {
+      unsigned char Parts = Private ? Collection->second.Any : Collection->second.Public;
+      if ((Parts & CP_CountOf) && (Parts & (CP_ObjectInAtIndex | CP_AtIndexes)))
+        addCapitalizedEntry(Collection->getKey(), AK_OrderedCollection, OrderedProxyType, Private);
+      else if ((Parts & CP_CountOf) && (Parts & CP_EnumeratorOf) && (Parts & CP_MemberOf))
+        addCapitalizedEntry(Collection->getKey(), AK_UnorderedCollection, UnorderedProxyType, Private);
+    }
+  }
+}
+
+
+void KVCAccessorTable::addEntry(StringRef Key, AccessorKind Kind, QualType Type, bool Private) {
+  Slot &S = Keys[Key];
+  if (Kind <= S.Any.Kind) {
+    S.Any.Kind = Kind;
+    S.Any.Type = Type;
+  }
+  if (!Private && Kind <= S.Public.Kind) {
+    S.Public.Kind = Kind;
+    S.Public.Type = Type;
+  }
+}
+
+
+// Accessor names contain the key with its first letter capitalized, so both
+// "URL" and "uRL" are answered by -getURL.
+void KVCAccessorTable::addCapitalizedEntry(StringRef CapitalizedKey, AccessorKind Kind, QualType Type, bool Private) {
+  addEntry(CapitalizedKey, Kind, Type, Private);
+
+  if (!isUppercaseAt(CapitalizedKey, 0))
+    return;
+  SmallString<64> Key(CapitalizedKey);
+  Key[0] = toLowercase(Key[0]);
+  addEntry(Key, Kind, Type, Private);
+}
+
+
+void KVCAccessorTable::addCollectionPart(StringRef CapitalizedKey, CollectionPart Part, bool Private) {
+  if (!isUppercaseAt(CapitalizedKey, 0))
+    return;
+
+  CollectionParts &Parts = Collections[CapitalizedKey];
+  Parts.Any |= Part;
+  if (!Private)
+    Parts.Public |= Part;
+}
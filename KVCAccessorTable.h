@@ -0,0 +1,92 @@
+//
+// KVCAccessorTable.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KVC_ACCESSOR_TABLE_H
+#define CLANG_KPV_KVC_ACCESSOR_TABLE_H
+
+#include "clang/AST/DeclObjC.h"
+#include "clang/AST/Type.h"
+#include "llvm/ADT/StringMap.h"
+
+using namespace clang;
+
+
+// Flattened view of every key an Objective-C class (or protocol) answers to
+// through -valueForKey:, following the search order of the default
+// implementation in NSObject. Built once per container by
+// KeyPathValidationConsumer::getAccessorTable, merging superclasses,
+// categories and protocols, after which each key is a single lookup.
+class KVCAccessorTable {
+public:
+  // In order of precedence
+  enum AccessorKind {
+    AK_GetKey,              // -getKey
+    AK_Key,                 // -key
+    AK_IsKey,               // -isKey
+    AK_OrderedCollection,   // -countOfKey with -objectInKeyAtIndex: or -keyAtIndexes:
+    AK_UnorderedCollection, // -countOfKey, -enumeratorOfKey and -memberOfKey:
+    AK_CollectionProperty,  // collection-typed @property with a custom getter
+    AK_Ivar,                // _key, _isKey, key or isKey instance variable
+    AK_None
+  };
+
+  struct Entry {
+    Entry() : Kind(AK_None) { }
+
+    QualType Type;
+    AccessorKind Kind;
+  };
+
+  // Private accessors are those only visible in the @implementation.
+  const Entry *lookup(StringRef Key, bool AllowPrivate) const;
+
+  void mergeFrom(const KVCAccessorTable &Other);
+  void addMethod(const ObjCMethodDecl *Method, bool Private);
+  void addIvar(const ObjCIvarDecl *Ivar, bool Private);
+  void addCollectionProperty(const ObjCPropertyDecl *Property);
+  // Call once all methods are added; proxy types are those returned for the
+  // ordered and unordered collection accessor patterns.
+  void addCollectionAccessors(QualType OrderedProxyType, QualType UnorderedProxyType);
+
+  struct Slot {
+    Entry Public, Any;
+  };
+  struct CollectionParts {
+    CollectionParts() : Public(0), Any(0) { }
+
+    unsigned char Public, Any;
+  };
+
+  // Raw contents, for writing to and loading from a KVCSummary
+  typedef llvm::StringMap<Slot>::const_iterator slot_iterator;
+  slot_iterator slot_begin() const { return Keys.begin(); }
+  slot_iterator slot_end() const { return Keys.end(); }
+  typedef llvm::StringMap<CollectionParts>::const_iterator collection_iterator;
+  collection_iterator collection_begin() const { return Collections.begin(); }
+  collection_iterator collection_end() const { return Collections.end(); }
+  void setSlot(StringRef Key, const Slot &S) { Keys[Key] = S; }
+  void setCollectionParts(StringRef CapitalizedKey, CollectionParts Parts) { Collections[CapitalizedKey] = Parts; }
+
+private:
+  enum CollectionPart {
+    CP_CountOf = 1 << 0,
+    CP_ObjectInAtIndex = 1 << 1,
+    CP_AtIndexes = 1 << 2,
+    CP_EnumeratorOf = 1 << 3,
+    CP_MemberOf = 1 << 4
+  };
+
+  llvm::StringMap<Slot> Keys;
+  // Keyed on the capitalized key, as it appears in the accessor names
+  llvm::StringMap<CollectionParts> Collections;
+
+  void addEntry(StringRef Key, AccessorKind Kind, QualType Type, bool Private);
+  void addCapitalizedEntry(StringRef CapitalizedKey, AccessorKind Kind, QualType Type, bool Private);
+  void addCollectionPart(StringRef CapitalizedKey, CollectionPart Part, bool Private);
+};
+
+#endif
@@ -0,0 +1,402 @@
+//
+// KVCSummary.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KVCSummary.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <string.h>
+
+using llvm::SmallString;
+using llvm::support::ulittle32_t;
+
+
+static const char SummaryMagic[4] = { 'K', 'V', 'C', 'S' };
+static const uint32_t SummaryVersion = 3;
+
+namespace {
+
+struct RawHeader {
+  char Magic[4];
+  ulittle32_t Version;
+  ulittle32_t NumContainers, NumEntries, NumTypes, NumProtocols, StringsSize;
+};
+
+}
+
+struct KVCSummary::RawContainer {
+  ulittle32_t Name, Flags, Stamp, FirstEntry, NumEntries;
+  ulittle32_t SuperClass, FirstProtocol, NumProtocols;
+};
+
+struct KVCSummary::RawEntry {
+  ulittle32_t Key;
+  ulittle32_t Kinds; // public kind, private kind, public parts, private parts
+  ulittle32_t PublicType, AnyType;
+};
+
+struct KVCSummary::RawType {
+  ulittle32_t Tag, InterfaceName, FirstProtocol, NumProtocols;
+};
+
+
+const uint32_t KVCSummary::NoIndex;
+
+
+KVCSummary::KVCSummary()
+  : Containers(NULL), Entries(NULL), Types(NULL), Protocols(NULL), Strings(NULL)
+  , NumContainers(0), NumEntries(0), NumTypes(0), NumProtocols(0), StringsSize(0)
+{ }
+
+KVCSummary::~KVCSummary() { }
+
+
+KVCSummary *KVCSummary::load(StringRef Path) {
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  // Large files are mapped rather than read
+  if (llvm::MemoryBuffer::getFile(Path, Buffer, -1, /*RequiresNullTerminator=*/false))
+    return NULL;
+
+  const char *Start = Buffer->getBufferStart();
+  size_t Size = Buffer->getBufferSize();
+  if (Size < sizeof(RawHeader))
+    return NULL;
+  const RawHeader *Header = reinterpret_cast<const RawHeader *>(Start);
+  if (memcmp(Header->Magic, SummaryMagic, sizeof(SummaryMagic)) != 0 || Header->Version != SummaryVersion)
+    return NULL;
+
+  uint64_t Expected = sizeof(RawHeader)
+    + uint64_t(Header->NumContainers) * sizeof(RawContainer)
+    + uint64_t(Header->NumEntries) * sizeof(RawEntry)
+    + uint64_t(Header->NumTypes) * sizeof(RawType)
+    + uint64_t(Header->NumProtocols) * sizeof(RawProtocol)
+    + Header->StringsSize;
+  if (Expected != Size || Header->StringsSize == 0 || Start[Size - 1] != '\0')
+    return NULL;
+
+  llvm::OwningPtr<KVCSummary> Summary(new KVCSummary);
+  Summary->NumContainers = Header->NumContainers;
+  Summary->NumEntries = Header->NumEntries;
+  Summary->NumTypes = Header->NumTypes;
+  Summary->NumProtocols = Header->NumProtocols;
+  Summary->StringsSize = Header->StringsSize;
+
+  const char *Cursor = Start + sizeof(RawHeader);
+  Summary->Containers = reinterpret_cast<const RawContainer *>(Cursor);
+  Cursor += Summary->NumContainers * sizeof(RawContainer);
+  Summary->Entries = reinterpret_cast<const RawEntry *>(Cursor);
+  Cursor += Summary->NumEntries * sizeof(RawEntry);
+  Summary->Types = reinterpret_cast<const RawType *>(Cursor);
+  Cursor += Summary->NumTypes * sizeof(RawType);
+  Summary->Protocols = Cursor;
+  Cursor += Summary->NumProtocols * sizeof(RawProtocol);
+  Summary->Strings = Cursor;
+
+  Summary->Buffer.swap(Buffer);
+  return Summary.take();
+}
+
+
+namespace {
+
+struct SharedSummary {
+  llvm::sys::fs::UniqueID ID;
+  uint64_t Size;
+  llvm::sys::TimeValue ModificationTime;
+  llvm::IntrusiveRefCntPtr<KVCSummary> Summary;
+};
+
+struct SharedSummaries {
+  llvm::sys::Mutex Lock;
+  llvm::StringMap<SharedSummary> ByPath;
+};
+
+llvm::ManagedStatic<SharedSummaries> Shared;
+
+}
+
+
+// Summaries are replaced by renaming a new file over the old, so a changed
+// file has a new ID.
+llvm::IntrusiveRefCntPtr<KVCSummary> KVCSummary::loadShared(StringRef Path) {
+  llvm::sys::fs::file_status Status;
+  if (llvm::sys::fs::status(Path, Status))
+    return llvm::IntrusiveRefCntPtr<KVCSummary>();
+
+  llvm::sys::ScopedLock Locked(Shared->Lock);
+  SharedSummary &Entry = Shared->ByPath[Path];
+  if (Entry.Summary && Entry.ID == Status.getUniqueID() && Entry.Size == Status.getSize() &&
+      Entry.ModificationTime == Status.getLastModificationTime())
+    return Entry.Summary;
+
+  Entry.ID = Status.getUniqueID();
+  Entry.Size = Status.getSize();
+  Entry.ModificationTime = Status.getLastModificationTime();
+  Entry.Summary = llvm::IntrusiveRefCntPtr<KVCSummary>(load(Path));
+  return Entry.Summary;
+}
+
+
+StringRef KVCSummary::getString(uint32_t Offset) const {
+  if (Offset >= StringsSize)
+    return StringRef();
+  return StringRef(Strings + Offset);
+}
+
+
+bool KVCSummary::findContainer(StringRef Name, bool IsProtocol, Container &Out) const {
+  uint32_t Low = 0, High = NumContainers;
+  while (Low < High) {
+    uint32_t Middle = Low + (High - Low) / 2;
+    const RawContainer &C = Containers[Middle];
+    bool MiddleIsProtocol = C.Flags & CF_Protocol;
+    int Order = MiddleIsProtocol != IsProtocol ? (MiddleIsProtocol ? 1 : -1) : getString(C.Name).compare(Name);
+    if (Order == 0) {
+      if (C.FirstEntry > NumEntries || C.NumEntries > NumEntries - C.FirstEntry ||
+          C.FirstProtocol > NumProtocols || C.NumProtocols > NumProtocols - C.FirstProtocol)
+        return false;
+      Out.Stamp = getString(C.Stamp);
+      Out.SuperClass = C.SuperClass == NoIndex ? StringRef() : getString(C.SuperClass);
+      Out.Flags = C.Flags;
+      Out.FirstEntry = C.FirstEntry;
+      Out.NumEntries = C.NumEntries;
+      Out.FirstProtocol = C.FirstProtocol;
+      Out.NumProtocols = C.NumProtocols;
+      return true;
+    }
+    if (Order < 0)
+      Low = Middle + 1;
+    else
+      High = Middle;
+  }
+  return false;
+}
+
+
+void KVCSummary::getEntry(uint32_t Index, Entry &Out) const {
+  const RawEntry &E = Entries[Index];
+  uint32_t Kinds = E.Kinds;
+  Out.Key = getString(E.Key);
+  Out.PublicKind = Kinds & 0xff;
+  Out.AnyKind = (Kinds >> 8) & 0xff;
+  Out.PublicCollectionParts = (Kinds >> 16) & 0xff;
+  Out.AnyCollectionParts = (Kinds >> 24) & 0xff;
+  Out.PublicType = E.PublicType;
+  Out.AnyType = E.AnyType;
+}
+
+
+const KVCSummary::DecodedContainer *KVCSummary::getDecodedContainer(StringRef Name, bool IsProtocol) const {
+  SmallString<64> Key;
+  if (IsProtocol)
+    Key.push_back('@');
+  Key += Name;
+
+  llvm::sys::ScopedLock Locked(DecodedLock);
+  llvm::StringMap<DecodedSlot>::iterator Found = DecodedContainers.find(Key);
+  if (Found == DecodedContainers.end()) {
+    // Containers already handed out stay where they are as others are added
+    DecodedSlot &Decoded = DecodedContainers[Key];
+    Container Record;
+    Decoded.Found = findContainer(Name, IsProtocol, Record);
+    if (Decoded.Found) {
+      Decoded.Container.Stamp = Record.Stamp;
+      Decoded.Container.SuperClass = Record.SuperClass;
+      const ulittle32_t *Names = reinterpret_cast<const ulittle32_t *>(Protocols);
+      for (uint32_t P = Record.FirstProtocol, PEnd = Record.FirstProtocol + Record.NumProtocols; P != PEnd; ++P)
+        Decoded.Container.Protocols.push_back(getString(Names[P]));
+      Decoded.Container.Entries.resize(Record.NumEntries);
+      for (uint32_t I = 0; I != Record.NumEntries; ++I)
+        getEntry(Record.FirstEntry + I, Decoded.Container.Entries[I]);
+    }
+    Found = DecodedContainers.find(Key);
+  }
+  return Found->second.Found ? &Found->second.Container : NULL;
+}
+
+
+KVCSummary::TypeTag KVCSummary::getType(uint32_t Index, StringRef &InterfaceName, llvm::SmallVectorImpl<StringRef> &ProtocolNames) const {
+  const RawType &T = Types[Index];
+  InterfaceName = T.InterfaceName == NoIndex ? StringRef() : getString(T.InterfaceName);
+  ProtocolNames.clear();
+  const ulittle32_t *Names = reinterpret_cast<const ulittle32_t *>(Protocols);
+  for (uint32_t P = T.FirstProtocol, PEnd = T.FirstProtocol + T.NumProtocols; P < PEnd && P < NumProtocols; ++P)
+    ProtocolNames.push_back(getString(Names[P]));
+  return T.Tag <= TT_Other ? TypeTag(uint32_t(T.Tag)) : TT_Other;
+}
+
+
+KVCSummaryWriter::KVCSummaryWriter() {
+  // Offset 0 is the empty string
+  Strings.push_back('\0');
+  StringOffsets[""] = 0;
+}
+
+
+uint32_t KVCSummaryWriter::addString(StringRef S) {
+  llvm::StringMap<uint32_t>::iterator Found = StringOffsets.find(S);
+  if (Found != StringOffsets.end())
+    return Found->second;
+
+  uint32_t Offset = Strings.size();
+  Strings.append(S.begin(), S.end());
+  Strings.push_back('\0');
+  StringOffsets[S] = Offset;
+  return Offset;
+}
+
+
+void KVCSummaryWriter::addContainer(StringRef Name, unsigned Flags, StringRef Stamp, StringRef SuperClass, llvm::ArrayRef<std::string> ProtocolNames) {
+  PendingContainer C;
+  C.Name = addString(Name);
+  C.Flags = Flags;
+  C.Stamp = addString(Stamp);
+  C.FirstEntry = Entries.size();
+  C.NumEntries = 0;
+  C.SuperClass = SuperClass.empty() ? KVCSummary::NoIndex : addString(SuperClass);
+  C.FirstProtocol = Protocols.size();
+  C.NumProtocols = ProtocolNames.size();
+  for (llvm::ArrayRef<std::string>::iterator ProtocolName = ProtocolNames.begin(), ProtocolNameEnd = ProtocolNames.end();
+      ProtocolName != ProtocolNameEnd; ++ProtocolName)
+    Protocols.push_back(addString(*ProtocolName));
+  Containers.push_back(C);
+}
+
+
+void KVCSummaryWriter::addEntry(const KVCSummary::Entry &E) {
+  PendingEntry P;
+  P.Key = addString(E.Key);
+  P.Kinds = (E.PublicKind & 0xff) | (E.AnyKind & 0xff) << 8
+    | (E.PublicCollectionParts & 0xff) << 16 | (E.AnyCollectionParts & 0xff) << 24;
+  P.PublicType = E.PublicType;
+  P.AnyType = E.AnyType;
+  Entries.push_back(P);
+  ++Containers.back().NumEntries;
+}
+
+
+uint32_t KVCSummaryWriter::addType(KVCSummary::TypeTag Tag, StringRef InterfaceName, llvm::ArrayRef<std::string> ProtocolNames) {
+  SmallString<128> Signature;
+  Signature.push_back(char('0' + Tag));
+  Signature.append(InterfaceName.begin(), InterfaceName.end());
+  for (llvm::ArrayRef<std::string>::iterator Name = ProtocolNames.begin(), NameEnd = ProtocolNames.end();
+      Name != NameEnd; ++Name) {
+    Signature.push_back('<');
+    Signature.append(Name->begin(), Name->end());
+  }
+
+  llvm::StringMap<uint32_t>::iterator Found = TypeIndexes.find(Signature);
+  if (Found != TypeIndexes.end())
+    return Found->second;
+
+  PendingType T;
+  T.Tag = Tag;
+  T.InterfaceName = InterfaceName.empty() ? KVCSummary::NoIndex : addString(InterfaceName);
+  T.FirstProtocol = Protocols.size();
+  T.NumProtocols = ProtocolNames.size();
+  for (llvm::ArrayRef<std::string>::iterator Name = ProtocolNames.begin(), NameEnd = ProtocolNames.end();
+      Name != NameEnd; ++Name)
+    Protocols.push_back(addString(*Name));
+
+  uint32_t Index = Types.size();
+  Types.push_back(T);
+  TypeIndexes[Signature] = Index;
+  return Index;
+}
+
+
+namespace {
+
+struct PendingContainerOrder {
+  const std::string *Strings;
+
+  template <typename C>
+  bool operator()(const C &A, const C &B) const {
+    bool AIsProtocol = A.Flags & KVCSummary::CF_Protocol, BIsProtocol = B.Flags & KVCSummary::CF_Protocol;
+    if (AIsProtocol != BIsProtocol)
+      return BIsProtocol;
+    return StringRef(Strings->c_str() + A.Name).compare(StringRef(Strings->c_str() + B.Name)) < 0;
+  }
+};
+
+void writeLittle32(llvm::raw_ostream &OS, uint32_t Value) {
+  ulittle32_t Raw;
+  Raw = Value;
+  OS.write(reinterpret_cast<const char *>(&Raw), sizeof(Raw));
+}
+
+}
+
+
+bool KVCSummaryWriter::write(StringRef Path, std::string &Error) {
+  // Entries stay where they are; containers refer to them by index
+  PendingContainerOrder Order = { &Strings };
+  std::sort(Containers.begin(), Containers.end(), Order);
+
+  int FD;
+  SmallString<256> TempPath;
+  if (llvm::error_code EC = llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", FD, TempPath)) {
+    Error = EC.message();
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS.write(SummaryMagic, sizeof(SummaryMagic));
+    writeLittle32(OS, SummaryVersion);
+    writeLittle32(OS, Containers.size());
+    writeLittle32(OS, Entries.size());
+    writeLittle32(OS, Types.size());
+    writeLittle32(OS, Protocols.size());
+    writeLittle32(OS, Strings.size());
+
+    for (std::vector<PendingContainer>::const_iterator C = Containers.begin(), CEnd = Containers.end(); C != CEnd; ++C) {
+      writeLittle32(OS, C->Name);
+      writeLittle32(OS, C->Flags);
+      writeLittle32(OS, C->Stamp);
+      writeLittle32(OS, C->FirstEntry);
+      writeLittle32(OS, C->NumEntries);
+      writeLittle32(OS, C->SuperClass);
+      writeLittle32(OS, C->FirstProtocol);
+      writeLittle32(OS, C->NumProtocols);
+    }
+    for (std::vector<PendingEntry>::const_iterator E = Entries.begin(), EEnd = Entries.end(); E != EEnd; ++E) {
+      writeLittle32(OS, E->Key);
+      writeLittle32(OS, E->Kinds);
+      writeLittle32(OS, E->PublicType);
+      writeLittle32(OS, E->AnyType);
+    }
+    for (std::vector<PendingType>::const_iterator T = Types.begin(), TEnd = Types.end(); T != TEnd; ++T) {
+      writeLittle32(OS, T->Tag);
+      writeLittle32(OS, T->InterfaceName);
+      writeLittle32(OS, T->FirstProtocol);
+      writeLittle32(OS, T->NumProtocols);
+    }
+    for (std::vector<uint32_t>::const_iterator P = Protocols.begin(), PEnd = Protocols.end(); P != PEnd; ++P)
+      writeLittle32(OS, *P);
+    OS.write(Strings.data(), Strings.size());
+
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath.str());
+      Error = "can't write " + TempPath.str().str();
+      return false;
+    }
+  }
+
+  if (llvm::error_code EC = llvm::sys::fs::rename(TempPath.str(), Path)) {
+    llvm::sys::fs::remove(TempPath.str());
+    Error = EC.message();
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,181 @@
+//
+// KVCSummary.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KVC_SUMMARY_H
+#define CLANG_KPV_KVC_SUMMARY_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/IntrusiveRefCntPtr.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include "llvm/Support/Mutex.h"
+#include <string>
+#include <vector>
+
+namespace llvm {
+  class MemoryBuffer;
+}
+
+using llvm::StringRef;
+
+
+// Accessor tables and KVC flags of every interface and protocol defined while
+// building a precompiled header, written next to the PCH so that translation
+// units including it map the file instead of rebuilding them. Each container
+// has only the accessors it declares itself, with the names of its superclass
+// and protocols, whose tables readers merge in as getAccessorTable does; so
+// inherited keys aren't repeated for every subclass and adopting class.
+// Types are stored by name and looked up again in the reading translation
+// unit.
+//
+// Each container carries a stamp of the files declaring it and its
+// categories, by name, size and modification time. A container whose files
+// have changed since, as when the PCH was rebuilt without the summary, is
+// collected from the AST instead.
+//
+// All integers are little-endian and 32 bits; strings are offsets into a
+// table of NUL-terminated strings at the end of the file.
+//
+//   Header      "KVCS", version, number of records in each section below
+//   Containers  name, flags, stamp, first entry, number of entries,
+//               superclass name or NoIndex, first protocol, number of
+//               protocols; sorted on (CF_Protocol, name) for binary search
+//   Entries     key, public and private kinds and collection parts, public
+//               and private result types
+//   Types       tag, interface name, first protocol, number of protocols
+//   Protocols   name of each protocol qualifying a type or inherited by a
+//               container
+//   Strings
+//
+// A process that validates many translation units against the same PCH
+// (validate-key-paths -serve) loads each summary once with loadShared(), and
+// each container's entries are decoded once, on first use, and kept with it.
+class KVCSummary : public llvm::ThreadSafeRefCountedBase<KVCSummary> {
+public:
+  enum ContainerFlags {
+    CF_Protocol = 1 << 0,
+    CF_KVCContainer = 1 << 1,
+    CF_KVCCollection = 1 << 2
+  };
+
+  enum TypeTag {
+    TT_Object,  // id or interface pointer, possibly protocol-qualified
+    TT_Class,   // Class
+    TT_Number,  // boxed in an NSNumber by -valueForKey:
+    TT_Other    // other non-object type; ends type tracking
+  };
+
+  static const uint32_t NoIndex = ~0U;
+
+  struct Container {
+    StringRef Stamp, SuperClass;
+    uint32_t Flags, FirstEntry, NumEntries, FirstProtocol, NumProtocols;
+  };
+
+  struct Entry {
+    StringRef Key;
+    // KVCAccessorTable::AccessorKind and CollectionParts bits
+    unsigned PublicKind, AnyKind;
+    unsigned PublicCollectionParts, AnyCollectionParts;
+    uint32_t PublicType, AnyType;
+  };
+
+  ~KVCSummary();
+
+  // Returns NULL if the file is missing or not a summary of this version.
+  static KVCSummary *load(StringRef Path);
+  // The summary already loaded from Path by this process, unless the file
+  // has since been replaced. Safe to call from several threads.
+  static llvm::IntrusiveRefCntPtr<KVCSummary> loadShared(StringRef Path);
+
+  bool findContainer(StringRef Name, bool IsProtocol, Container &Out) const;
+  void getEntry(uint32_t Index, Entry &Out) const;
+  // A container's stamp, what it inherits from and all its entries,
+  // decoded; they live as long as the summary. NULL if the container isn't
+  // in it.
+  struct DecodedContainer {
+    StringRef Stamp, SuperClass;
+    std::vector<StringRef> Protocols;
+    std::vector<Entry> Entries;
+  };
+  const DecodedContainer *getDecodedContainer(StringRef Name, bool IsProtocol) const;
+  unsigned getNumTypes() const { return NumTypes; }
+  TypeTag getType(uint32_t Index, StringRef &InterfaceName, llvm::SmallVectorImpl<StringRef> &ProtocolNames) const;
+
+private:
+  struct RawContainer;
+  struct RawEntry;
+  struct RawType;
+  typedef uint32_t RawProtocol;
+
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  const RawContainer *Containers;
+  const RawEntry *Entries;
+  const RawType *Types;
+  const char *Protocols; // little-endian RawProtocols
+  const char *Strings;
+  uint32_t NumContainers, NumEntries, NumTypes, NumProtocols, StringsSize;
+
+  // Keyed on the name, prefixed with '@' for protocols
+  struct DecodedSlot {
+    DecodedSlot() : Found(false) { }
+
+    bool Found;
+    DecodedContainer Container;
+  };
+  mutable llvm::sys::Mutex DecodedLock;
+  mutable llvm::StringMap<DecodedSlot> DecodedContainers;
+
+  KVCSummary();
+  StringRef getString(uint32_t Offset) const;
+
+  friend class KVCSummaryWriter;
+};
+
+
+// Collects containers and entries in memory, then writes them out at once.
+class KVCSummaryWriter {
+public:
+  KVCSummaryWriter();
+
+  // Following entries belong to this container. SuperClass is empty for root
+  // classes and protocols.
+  void addContainer(StringRef Name, unsigned Flags, StringRef Stamp, StringRef SuperClass, llvm::ArrayRef<std::string> ProtocolNames);
+  void addEntry(const KVCSummary::Entry &E);
+  // Returns an index for Entry::PublicType and AnyType; equal types share one.
+  uint32_t addType(KVCSummary::TypeTag Tag, StringRef InterfaceName, llvm::ArrayRef<std::string> ProtocolNames);
+
+  // Replaces Path atomically, so concurrent readers see the old or the new
+  // summary, never part of one.
+  bool write(StringRef Path, std::string &Error);
+
+private:
+  struct PendingContainer {
+    uint32_t Name, Flags, Stamp, FirstEntry, NumEntries, SuperClass, FirstProtocol, NumProtocols;
+  };
+  struct PendingEntry {
+    uint32_t Key, Kinds, PublicType, AnyType;
+  };
+  struct PendingType {
+    uint32_t Tag, InterfaceName, FirstProtocol, NumProtocols;
+  };
+
+  std::vector<PendingContainer> Containers;
+  std::vector<PendingEntry> Entries;
+  std::vector<PendingType> Types;
+  std::vector<uint32_t> Protocols;
+  std::string Strings;
+  llvm::StringMap<uint32_t> StringOffsets;
+  llvm::StringMap<uint32_t> TypeIndexes;
+
+  uint32_t addString(StringRef S);
+};
+
+#endif
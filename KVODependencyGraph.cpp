@@ -0,0 +1,242 @@
+//
+// KVODependencyGraph.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KVODependencyGraph.h"
+#include "JSONOutput.h"
+#include "llvm/ADT/SmallString.h"
+#include <algorithm>
+
+using llvm::ArrayRef;
+
+
+unsigned KVODependencyGraph::getNode(StringRef Class, StringRef Key) {
+  llvm::SmallString<64> Name(Class);
+  Name += '.';
+  Name += Key;
+  llvm::StringMap<unsigned>::iterator Found = NodeIndexes.find(Name);
+  if (Found != NodeIndexes.end())
+    return Found->second;
+
+  Node N;
+  N.Class = Class;
+  N.Key = Key;
+  Nodes.push_back(N);
+  NodeIndexes[Name] = Nodes.size() - 1;
+  return Nodes.size() - 1;
+}
+
+
+void KVODependencyGraph::addDependency(StringRef Class, StringRef Key, StringRef KeyPath, bool Valid, ArrayRef<Step> Steps) {
+  unsigned Affected = getNode(Class, Key);
+  // A method validated twice (while streaming) reports the same key paths again
+  for (std::vector<unsigned>::const_iterator I = Nodes[Affected].Dependencies.begin(), E = Nodes[Affected].Dependencies.end(); I != E; ++I)
+    if (Dependencies[*I].KeyPath == KeyPath)
+      return;
+
+  Dependency D;
+  D.Affected = Affected;
+  D.KeyPath = KeyPath;
+  D.Valid = Valid;
+  D.ToMany = false;
+  for (ArrayRef<Step>::iterator S = Steps.begin(), SEnd = Steps.end(); S != SEnd; ++S) {
+    // The last key being to-many only means observing the collection itself
+    D.ToMany |= S->ToMany && S + 1 != SEnd;
+    if (S->Class.empty())
+      continue;
+    unsigned Trigger = getNode(S->Class, S->Key);
+    D.Via.push_back(Trigger);
+    std::vector<unsigned> &Triggers = Nodes[Trigger].Triggers;
+    if (std::find(Triggers.begin(), Triggers.end(), Affected) == Triggers.end())
+      Triggers.push_back(Affected);
+  }
+  Dependencies.push_back(D);
+  Nodes[Affected].Dependencies.push_back(Dependencies.size() - 1);
+}
+
+
+void KVODependencyGraph::getReachable(unsigned From, std::vector<unsigned> &Reachable) const {
+  std::vector<bool> Seen(Nodes.size());
+  std::vector<unsigned> Worklist(1, From);
+  Seen[From] = true;
+  while (!Worklist.empty()) {
+    unsigned Current = Worklist.back();
+    Worklist.pop_back();
+    for (std::vector<unsigned>::const_iterator Next = Nodes[Current].Triggers.begin(), NextEnd = Nodes[Current].Triggers.end(); Next != NextEnd; ++Next) {
+      if (Seen[*Next])
+        continue;
+      Seen[*Next] = true;
+      Reachable.push_back(*Next);
+      Worklist.push_back(*Next);
+    }
+  }
+}
+
+
+namespace {
+
+// Tarjan's algorithm
+struct CycleFinder {
+  const std::vector<std::vector<unsigned> > &Edges;
+  std::vector<unsigned> Index, LowLink;
+  std::vector<bool> OnStack;
+  std::vector<unsigned> Stack;
+  unsigned NextIndex;
+  std::vector<std::vector<unsigned> > &Cycles;
+
+  CycleFinder(const std::vector<std::vector<unsigned> > &Edges, std::vector<std::vector<unsigned> > &Cycles)
+    : Edges(Edges)
+    , Index(Edges.size(), ~0U)
+    , LowLink(Edges.size())
+    , OnStack(Edges.size())
+    , NextIndex(0)
+    , Cycles(Cycles)
+  { }
+
+  void visit(unsigned V) {
+    Index[V] = LowLink[V] = NextIndex++;
+    Stack.push_back(V);
+    OnStack[V] = true;
+
+    bool SelfLoop = false;
+    for (std::vector<unsigned>::const_iterator W = Edges[V].begin(), WEnd = Edges[V].end(); W != WEnd; ++W) {
+      SelfLoop |= *W == V;
+      if (Index[*W] == ~0U) {
+        visit(*W);
+        LowLink[V] = std::min(LowLink[V], LowLink[*W]);
+      } else if (OnStack[*W])
+        LowLink[V] = std::min(LowLink[V], Index[*W]);
+    }
+    if (LowLink[V] != Index[V])
+      return;
+
+    std::vector<unsigned> Component;
+    unsigned W;
+    do {
+      W = Stack.back();
+      Stack.pop_back();
+      OnStack[W] = false;
+      Component.push_back(W);
+    } while (W != V);
+    if (Component.size() > 1 || SelfLoop)
+      Cycles.push_back(Component);
+  }
+};
+
+}
+
+
+void KVODependencyGraph::getCycles(std::vector<std::vector<unsigned> > &Cycles) const {
+  std::vector<std::vector<unsigned> > Edges(Nodes.size());
+  for (size_t I = 0, E = Nodes.size(); I != E; ++I)
+    Edges[I] = Nodes[I].Triggers;
+  CycleFinder Finder(Edges, Cycles);
+  for (unsigned I = 0, E = Nodes.size(); I != E; ++I)
+    if (Finder.Index[I] == ~0U)
+      Finder.visit(I);
+}
+
+
+void KVODependencyGraph::printNodeName(llvm::raw_ostream &OS, unsigned Index) const {
+  printJSONString(OS, Nodes[Index].Class + "." + Nodes[Index].Key);
+}
+
+
+namespace {
+
+struct NodeNameLess {
+  const std::vector<StringRef> *Names;
+
+  bool operator()(unsigned A, unsigned B) const { return (*Names)[A] < (*Names)[B]; }
+};
+
+}
+
+
+void KVODependencyGraph::writeJSON(llvm::raw_ostream &OS, StringRef MainFile) const {
+  // Sorted by class, then key, so graphs can be diffed
+  std::vector<StringRef> Names(Nodes.size());
+  for (llvm::StringMap<unsigned>::const_iterator I = NodeIndexes.begin(), E = NodeIndexes.end(); I != E; ++I)
+    Names[I->second] = I->first();
+  NodeNameLess Less = { &Names };
+  std::vector<unsigned> Order;
+  for (unsigned I = 0, E = Nodes.size(); I != E; ++I)
+    Order.push_back(I);
+  std::sort(Order.begin(), Order.end(), Less);
+
+  OS << "{\n  \"file\": ";
+  printJSONString(OS, MainFile);
+  OS << ",\n  \"classes\": [";
+  for (size_t I = 0, E = Order.size(); I != E; ++I) {
+    const Node &N = Nodes[Order[I]];
+    bool NewClass = I == 0 || Nodes[Order[I - 1]].Class != N.Class;
+    if (NewClass) {
+      OS << (I ? "\n    ]},\n    {\"class\": " : "\n    {\"class\": ");
+      printJSONString(OS, N.Class);
+      OS << ", \"keys\": [";
+    }
+
+    std::vector<unsigned> Reachable;
+    getReachable(Order[I], Reachable);
+    std::sort(Reachable.begin(), Reachable.end(), Less);
+
+    OS << (NewClass ? "\n      {\"key\": " : ",\n      {\"key\": ");
+    printJSONString(OS, N.Key);
+    OS << ", \"fan_out\": " << Reachable.size() << ", \"triggers\": [";
+    for (size_t R = 0, RE = Reachable.size(); R != RE; ++R) {
+      OS << (R ? ", " : "");
+      printNodeName(OS, Reachable[R]);
+    }
+    OS << "],\n       \"depends_on\": [";
+    for (size_t DI = 0, DE = N.Dependencies.size(); DI != DE; ++DI) {
+      const Dependency &D = Dependencies[N.Dependencies[DI]];
+      OS << (DI ? ",\n         {\"key_path\": " : "\n         {\"key_path\": ");
+      printJSONString(OS, D.KeyPath);
+      OS << ", \"valid\": " << (D.Valid ? "true" : "false") << ", \"to_many\": " << (D.ToMany ? "true" : "false") << ", \"via\": [";
+      for (size_t V = 0, VE = D.Via.size(); V != VE; ++V) {
+        OS << (V ? ", " : "");
+        printNodeName(OS, D.Via[V]);
+      }
+      OS << "]}";
+    }
+    OS << "]}";
+  }
+  OS << (Order.empty() ? "],\n" : "\n    ]}\n  ],\n");
+
+  std::vector<std::vector<unsigned> > Cycles;
+  getCycles(Cycles);
+  OS << "  \"cycles\": [";
+  for (size_t C = 0, CE = Cycles.size(); C != CE; ++C) {
+    std::sort(Cycles[C].begin(), Cycles[C].end(), Less);
+    OS << (C ? ",\n    [" : "\n    [");
+    for (size_t V = 0, VE = Cycles[C].size(); V != VE; ++V) {
+      OS << (V ? ", " : "");
+      printNodeName(OS, Cycles[C][V]);
+    }
+    OS << "]";
+  }
+  OS << (Cycles.empty() ? "],\n" : "\n  ],\n");
+
+  OS << "  \"to_many\": [";
+  bool First = true;
+  for (size_t I = 0, E = Order.size(); I != E; ++I) {
+    const Node &N = Nodes[Order[I]];
+    for (size_t DI = 0, DE = N.Dependencies.size(); DI != DE; ++DI) {
+      const Dependency &D = Dependencies[N.Dependencies[DI]];
+      if (!D.ToMany)
+        continue;
+      OS << (First ? "\n    {\"class\": " : ",\n    {\"class\": ");
+      First = false;
+      printJSONString(OS, N.Class);
+      OS << ", \"key\": ";
+      printJSONString(OS, N.Key);
+      OS << ", \"key_path\": ";
+      printJSONString(OS, D.KeyPath);
+      OS << "}";
+    }
+  }
+  OS << (First ? "]\n" : "\n  ]\n") << "}\n";
+}
@@ -0,0 +1,78 @@
+//
+// KVODependencyGraph.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KVO_DEPENDENCY_GRAPH_H
+#define CLANG_KPV_KVO_DEPENDENCY_GRAPH_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/raw_ostream.h"
+#include <string>
+#include <vector>
+
+using llvm::StringRef;
+
+
+// The KVO dependencies declared by +keyPathsForValuesAffecting<Key>. When
+// any key along a key path it returns changes, KVO notifies observers of
+// <Key> too, and so on for keys depending on <Key>. Nodes are (class, key);
+// an edge runs from each key along a key path to the key depending on it.
+//
+// Written as JSON for each translation unit, per class and key:
+//
+//   depends_on  the key paths returned, whether each resolved, whether it
+//               goes through a to-many relationship (so KVO observes every
+//               element), and the nodes along it
+//   triggers    every key notified, directly or transitively, when this key
+//               changes; fan_out is how many
+//
+// followed by the cycles (strongly connected components) and the to-many
+// dependencies. utils/kvo_graph.py merges the files of many translation
+// units and ranks keys by fan-out across them.
+class KVODependencyGraph {
+public:
+  // One key along a dependency's key path. Class is empty when the key is
+  // looked up on something other than a known class (say, the elements of
+  // a collection), in which case it's left out of the graph.
+  struct Step {
+    std::string Class;
+    StringRef Key;
+    bool ToMany;      // resolves to an NSArray, NSOrderedSet or NSSet
+  };
+
+  // Steps cover the keys of KeyPath that resolved; Valid if that's all of them.
+  void addDependency(StringRef Class, StringRef Key, StringRef KeyPath, bool Valid, llvm::ArrayRef<Step> Steps);
+  bool empty() const { return Dependencies.empty(); }
+
+  void writeJSON(llvm::raw_ostream &OS, StringRef MainFile) const;
+
+private:
+  struct Node {
+    std::string Class, Key;
+    std::vector<unsigned> Triggers;      // direct, no duplicates
+    std::vector<unsigned> Dependencies;  // depending on this node
+  };
+
+  struct Dependency {
+    unsigned Affected;
+    std::string KeyPath;
+    bool Valid, ToMany;
+    std::vector<unsigned> Via;
+  };
+
+  llvm::StringMap<unsigned> NodeIndexes;
+  std::vector<Node> Nodes;
+  std::vector<Dependency> Dependencies;
+
+  unsigned getNode(StringRef Class, StringRef Key);
+  void getReachable(unsigned From, std::vector<unsigned> &Reachable) const;
+  void getCycles(std::vector<std::vector<unsigned> > &Cycles) const;
+  void printNodeName(llvm::raw_ostream &OS, unsigned Index) const;
+};
+
+#endif
@@ -0,0 +1,85 @@
+//
+// KeyPathArgumentVisitor.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KeyPathArgumentVisitor.h"
+
+using namespace clang;
+
+
+KeyPathArgumentVisitor::KeyPathArgumentVisitor(KeyPathValidationConsumer *Consumer, const SelectorRegistry &Registry)
+  : Consumer(Consumer)
+  , Registry(Registry)
+{ }
+
+
+bool KeyPathArgumentVisitor::getTriggerIdentifiers(llvm::StringSet<> &Names, SmallVectorImpl<StringRef> &Prefixes) const {
+  Registry.getLeadingIdentifiers(Names);
+  return true;
+}
+
+
+void KeyPathArgumentVisitor::VisitObjCMessageExpr(ObjCMessageExpr *E) {
+  const SelectorRegistry::Entry *Entry = Registry.lookup(E->getSelector());
+  if (!Entry || !E->isInstanceMessage())
+    return;
+  Consumer->noteMatchedMessageSend();
+
+  const Expr *ModelExpr = NULL;
+  if (Entry->ModelArgument != SelectorRegistry::ReceiverArgument)
+    ModelExpr = E->getArg(Entry->ModelArgument);
+  const Expr *KeyExpr = E->getArg(Entry->KeyArgument);
+  bool SingleKeyPath = Entry->Kind == SelectorRegistry::KK_Key || Entry->Kind == SelectorRegistry::KK_KeyPath;
+  Consumer->reportSendInLoop(E, SingleKeyPath ? KeyExpr : NULL);
+
+  switch (Entry->Kind) {
+  case SelectorRegistry::KK_Key:
+  case SelectorRegistry::KK_KeyPath:
+    checkArgument(E, ModelExpr, KeyExpr, Entry->Kind == SelectorRegistry::KK_KeyPath);
+    break;
+
+  case SelectorRegistry::KK_KeyPathArray:
+    if (const ObjCArrayLiteral *KeyPathsLiteral = dyn_cast<ObjCArrayLiteral>(KeyExpr->IgnoreImplicit()))
+      for (unsigned I = 0, N = KeyPathsLiteral->getNumElements(); I < N; ++I)
+        checkArgument(E, ModelExpr, KeyPathsLiteral->getElement(I), true);
+    break;
+
+  case SelectorRegistry::KK_Bindings: {
+    const ObjCArrayLiteral *ModelsLiteral = dyn_cast<ObjCArrayLiteral>(ModelExpr->IgnoreImplicit());
+    const ObjCArrayLiteral *KeyPathsLiterals = dyn_cast<ObjCArrayLiteral>(KeyExpr->IgnoreImplicit());
+    if (!ModelsLiteral || !KeyPathsLiterals)
+      break;
+
+    if (ModelsLiteral->getNumElements() != KeyPathsLiterals->getNumElements()) {
+      Consumer->reportBindingsCountMismatch(ModelsLiteral, KeyPathsLiterals);
+      break;
+    }
+
+    for (unsigned ModelIdx = 0, ModelCount = ModelsLiteral->getNumElements(); ModelIdx < ModelCount; ++ModelIdx) {
+      const Expr *Model = ModelsLiteral->getElement(ModelIdx);
+      if (const ObjCArrayLiteral *KeyPathsLiteral = dyn_cast<ObjCArrayLiteral>(KeyPathsLiterals->getElement(ModelIdx)->IgnoreImplicit()))
+        for (unsigned KeyPathIdx = 0, KeyPathCount = KeyPathsLiteral->getNumElements(); KeyPathIdx < KeyPathCount; ++KeyPathIdx)
+          checkArgument(E, Model, KeyPathsLiteral->getElement(KeyPathIdx), true);
+    }
+    break;
+  }
+  }
+}
+
+
+// Keys and paths applying to an argument report its range too.
+void KeyPathArgumentVisitor::checkArgument(ObjCMessageExpr *E, const Expr *ModelExpr, const Expr *KeyExpr, bool IsKeyPath) {
+  QualType ModelType = ModelExpr ? ModelExpr->IgnoreImplicit()->getType() : E->getReceiverType();
+  if (!IsKeyPath) {
+    Consumer->emitDiagnosticsForTypeAndKey(ModelType, KeyExpr);
+    return;
+  }
+  if (ModelExpr)
+    Consumer->emitDiagnosticsForReceiverAndKeyPath(ModelExpr, KeyExpr);
+  else
+    Consumer->emitDiagnosticsForTypeAndKeyPath(ModelType, KeyExpr);
+  Consumer->reportKeyPathCost(ModelType, KeyExpr);
+}
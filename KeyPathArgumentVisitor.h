@@ -0,0 +1,35 @@
+//
+// KeyPathArgumentVisitor.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KEY_PATH_ARGUMENT_VISITOR_H
+#define CLANG_KPV_KEY_PATH_ARGUMENT_VISITOR_H
+
+#include "KeyPathValidationConsumer.h"
+#include "KeyPathValidationCheck.h"
+#include "SelectorRegistry.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+using namespace clang;
+
+
+// Checks the key and key path arguments of every message send whose selector
+// is in the registry (-valueForKey:, -addObserver:forKeyPath:..., binders).
+class KeyPathArgumentVisitor : public KeyPathValidationCheck {
+  KeyPathValidationConsumer *Consumer;
+  const SelectorRegistry &Registry;
+
+  void checkArgument(ObjCMessageExpr *E, const Expr *ModelExpr, const Expr *KeyExpr, bool IsKeyPath);
+
+public:
+  KeyPathArgumentVisitor(KeyPathValidationConsumer *Consumer, const SelectorRegistry &Registry);
+
+  virtual const char *getName() const { return "key-path-arguments"; }
+  virtual void VisitObjCMessageExpr(ObjCMessageExpr *E);
+  virtual bool getTriggerIdentifiers(llvm::StringSet<> &Names, SmallVectorImpl<StringRef> &Prefixes) const;
+};
+
+#endif
@@ -0,0 +1,188 @@
+//
+// KeyPathManifest.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KeyPathManifest.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/Endian.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+
+using llvm::SmallString;
+using llvm::support::ulittle32_t;
+
+
+static const char ManifestMagic[4] = { 'K', 'P', 'V', 'M' };
+static const uint32_t ManifestVersion = 1;
+
+
+KeyPathManifestWriter::KeyPathManifestWriter() {
+  // Offset 0 is the empty string
+  Strings.push_back('\0');
+  StringOffsets[""] = 0;
+}
+
+
+void KeyPathManifestWriter::addKeyPath(StringRef Class, StringRef KeyPath, StringRef AffectedKey, llvm::ArrayRef<Step> NewSteps) {
+  SmallString<128> Name(Class);
+  Name.push_back('\0');
+  Name += KeyPath;
+  Name.push_back('\0');
+  Name += AffectedKey;
+  if (KeyPathIndexes.count(Name))
+    return;
+  KeyPathIndexes[Name] = KeyPaths.size();
+
+  KeyPaths.push_back(PendingKeyPath());
+  PendingKeyPath &P = KeyPaths.back();
+  P.Class = Class;
+  P.KeyPath = KeyPath;
+  P.AffectedKey = AffectedKey;
+  for (llvm::ArrayRef<Step>::iterator S = NewSteps.begin(), SEnd = NewSteps.end(); S != SEnd; ++S) {
+    Name = S->Class;
+    Name.push_back('\0');
+    Name += S->Key;
+    llvm::StringMap<uint32_t>::iterator Found = StepIndexes.find(Name);
+    if (Found != StepIndexes.end()) {
+      P.Steps.push_back(Found->second);
+      continue;
+    }
+    PendingStep NewStep;
+    NewStep.Class = S->Class;
+    NewStep.Key = S->Key;
+    NewStep.Kind = S->Kind;
+    StepIndexes[Name] = Steps.size();
+    P.Steps.push_back(Steps.size());
+    Steps.push_back(NewStep);
+  }
+}
+
+
+uint32_t KeyPathManifestWriter::addString(StringRef S) {
+  llvm::StringMap<uint32_t>::iterator Found = StringOffsets.find(S);
+  if (Found != StringOffsets.end())
+    return Found->second;
+
+  uint32_t Offset = Strings.size();
+  Strings.append(S.begin(), S.end());
+  Strings.push_back('\0');
+  StringOffsets[S] = Offset;
+  return Offset;
+}
+
+
+namespace {
+
+// Orderings of indexes into the writer's steps and key paths
+template <typename S>
+struct StepOrder {
+  const std::vector<S> *Steps;
+
+  bool operator()(uint32_t A, uint32_t B) const {
+    const S &SA = (*Steps)[A], &SB = (*Steps)[B];
+    if (SA.Class != SB.Class)
+      return SA.Class < SB.Class;
+    return SA.Key < SB.Key;
+  }
+};
+
+template <typename P>
+struct KeyPathOrder {
+  const std::vector<P> *KeyPaths;
+
+  bool operator()(uint32_t A, uint32_t B) const {
+    const P &PA = (*KeyPaths)[A], &PB = (*KeyPaths)[B];
+    if (PA.Class != PB.Class)
+      return PA.Class < PB.Class;
+    if (PA.KeyPath != PB.KeyPath)
+      return PA.KeyPath < PB.KeyPath;
+    return PA.AffectedKey < PB.AffectedKey;
+  }
+};
+
+void writeLittle32(llvm::raw_ostream &OS, uint32_t Value) {
+  ulittle32_t Raw;
+  Raw = Value;
+  OS.write(reinterpret_cast<const char *>(&Raw), sizeof(Raw));
+}
+
+}
+
+
+bool KeyPathManifestWriter::write(StringRef Path, std::string &Error) {
+  // Sorted, with strings added in the order they're written, so that the
+  // same key paths always give the same file
+  std::vector<uint32_t> StepOrdering, KeyPathOrdering;
+  for (uint32_t I = 0, E = Steps.size(); I != E; ++I)
+    StepOrdering.push_back(I);
+  StepOrder<PendingStep> ByStep = { &Steps };
+  std::sort(StepOrdering.begin(), StepOrdering.end(), ByStep);
+  std::vector<uint32_t> NewStepIndexes(Steps.size());
+  for (uint32_t I = 0, E = StepOrdering.size(); I != E; ++I)
+    NewStepIndexes[StepOrdering[I]] = I;
+
+  for (uint32_t I = 0, E = KeyPaths.size(); I != E; ++I)
+    KeyPathOrdering.push_back(I);
+  KeyPathOrder<PendingKeyPath> ByKeyPath = { &KeyPaths };
+  std::sort(KeyPathOrdering.begin(), KeyPathOrdering.end(), ByKeyPath);
+
+  std::vector<uint32_t> KeyPathRecords, StepRecords, PathSteps;
+  for (std::vector<uint32_t>::const_iterator I = KeyPathOrdering.begin(), E = KeyPathOrdering.end(); I != E; ++I) {
+    const PendingKeyPath &P = KeyPaths[*I];
+    KeyPathRecords.push_back(addString(P.Class));
+    KeyPathRecords.push_back(addString(P.KeyPath));
+    KeyPathRecords.push_back(addString(P.AffectedKey));
+    KeyPathRecords.push_back(PathSteps.size());
+    KeyPathRecords.push_back(P.Steps.size());
+    for (std::vector<uint32_t>::const_iterator S = P.Steps.begin(), SEnd = P.Steps.end(); S != SEnd; ++S)
+      PathSteps.push_back(NewStepIndexes[*S]);
+  }
+  for (std::vector<uint32_t>::const_iterator I = StepOrdering.begin(), E = StepOrdering.end(); I != E; ++I) {
+    StepRecords.push_back(addString(Steps[*I].Class));
+    StepRecords.push_back(addString(Steps[*I].Key));
+    StepRecords.push_back(Steps[*I].Kind);
+  }
+
+  int FD;
+  SmallString<256> TempPath;
+  if (llvm::error_code EC = llvm::sys::fs::createUniqueFile(Path + "-%%%%%%%%", FD, TempPath)) {
+    Error = EC.message();
+    return false;
+  }
+
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS.write(ManifestMagic, sizeof(ManifestMagic));
+    writeLittle32(OS, ManifestVersion);
+    writeLittle32(OS, KeyPaths.size());
+    writeLittle32(OS, Steps.size());
+    writeLittle32(OS, PathSteps.size());
+    writeLittle32(OS, Strings.size());
+    for (std::vector<uint32_t>::const_iterator I = KeyPathRecords.begin(), E = KeyPathRecords.end(); I != E; ++I)
+      writeLittle32(OS, *I);
+    for (std::vector<uint32_t>::const_iterator I = StepRecords.begin(), E = StepRecords.end(); I != E; ++I)
+      writeLittle32(OS, *I);
+    for (std::vector<uint32_t>::const_iterator I = PathSteps.begin(), E = PathSteps.end(); I != E; ++I)
+      writeLittle32(OS, *I);
+    OS.write(Strings.data(), Strings.size());
+
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath.str());
+      Error = "can't write " + TempPath.str().str();
+      return false;
+    }
+  }
+
+  if (llvm::error_code EC = llvm::sys::fs::rename(TempPath.str(), Path)) {
+    llvm::sys::fs::remove(TempPath.str());
+    Error = EC.message();
+    return false;
+  }
+  return true;
+}
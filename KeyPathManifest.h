@@ -0,0 +1,79 @@
+//
+// KeyPathManifest.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KEY_PATH_MANIFEST_H
+#define CLANG_KPV_KEY_PATH_MANIFEST_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/DataTypes.h"
+#include <string>
+#include <vector>
+
+using llvm::StringRef;
+
+
+// Every literal key path a translation unit validated, with the class it
+// starts from and the accessor each of its keys resolves to, for an app to
+// look up at launch (off the main thread) rather than lazily. Key paths
+// returned by +keyPathsForValuesAffecting<Key> are included with <Key>, so
+// the KVO dependency sets can be built ahead of time too. utils/
+// merge_manifests.py merges the manifests of many translation units.
+//
+// All integers are little-endian and 32 bits; strings are offsets into a
+// table of NUL-terminated strings at the end of the file, where offset 0 is
+// the empty string.
+//
+//   Header     "KPVM", version, number of key paths, steps and path steps,
+//              size of the strings
+//   KeyPaths   class, key path, affected key (empty unless from
+//              +keyPathsForValuesAffecting<Key>), first path step, number of
+//              path steps; sorted on (class, key path, affected key)
+//   Steps      class, key, KVCAccessorTable::AccessorKind; sorted on
+//              (class, key)
+//   PathSteps  index into Steps of each key along a key path, in order
+//   Strings
+//
+// Keys looked up on something other than a known class (the elements of a
+// collection, say) have no step.
+class KeyPathManifestWriter {
+public:
+  struct Step {
+    StringRef Class, Key;
+    unsigned Kind;
+  };
+
+  KeyPathManifestWriter();
+
+  // A key path added again, say by a check replayed after streaming, is
+  // only written once.
+  void addKeyPath(StringRef Class, StringRef KeyPath, StringRef AffectedKey, llvm::ArrayRef<Step> Steps);
+
+  // Replaces Path atomically, like KVCSummaryWriter::write.
+  bool write(StringRef Path, std::string &Error);
+
+private:
+  struct PendingStep {
+    std::string Class, Key;
+    uint32_t Kind;
+  };
+  struct PendingKeyPath {
+    std::string Class, KeyPath, AffectedKey;
+    std::vector<uint32_t> Steps;
+  };
+
+  std::vector<PendingStep> Steps;
+  std::vector<PendingKeyPath> KeyPaths;
+  llvm::StringMap<uint32_t> StepIndexes, KeyPathIndexes;
+  std::string Strings;
+  llvm::StringMap<uint32_t> StringOffsets;
+
+  uint32_t addString(StringRef S);
+};
+
+#endif
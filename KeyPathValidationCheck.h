@@ -0,0 +1,37 @@
+//
+// KeyPathValidationCheck.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KEY_PATH_VALIDATION_CHECK_H
+#define CLANG_KPV_KEY_PATH_VALIDATION_CHECK_H
+
+#include "clang/AST/ExprObjC.h"
+#include "clang/AST/DeclObjC.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringSet.h"
+
+using namespace clang;
+
+
+// A check is handed the nodes it's interested in by CheckDispatchVisitor,
+// which walks the translation unit once on behalf of all registered checks.
+class KeyPathValidationCheck {
+public:
+  virtual ~KeyPathValidationCheck() {}
+
+  // For statistics and timing reports
+  virtual const char *getName() const = 0;
+
+  virtual void VisitObjCMessageExpr(ObjCMessageExpr *E) {}
+  virtual void VisitObjCMethodDecl(ObjCMethodDecl *D) {}
+
+  // Identifiers, or prefixes of them, at least one of which appears in the
+  // source of anything the check acts on. A translation unit mentioning none
+  // of any check's isn't traversed at all. False if the check can't tell.
+  virtual bool getTriggerIdentifiers(llvm::StringSet<> &Names, SmallVectorImpl<StringRef> &Prefixes) const { return false; }
+};
+
+#endif
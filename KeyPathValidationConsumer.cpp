@@ -7,10 +7,82 @@
 //
 
 #include "KeyPathValidationConsumer.h"
+#include "KVODependencyGraph.h"
+#include "WorkStealingPool.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Lex/Lexer.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 
 using namespace clang;
 
 
+// Into a caller's buffer, where getAsString() would allocate a std::string
+static StringRef printType(QualType Type, const PrintingPolicy &Policy, SmallVectorImpl<char> &Buffer) {
+  Buffer.clear();
+  llvm::raw_svector_ostream OS(Buffer);
+  Type.print(OS, Policy);
+  return OS.str();
+}
+
+static void printSelector(raw_ostream &OS, Selector Sel) {
+  if (Sel.getNumArgs() == 0)
+    OS << Sel.getNameForSlot(0);
+  for (unsigned I = 0, N = Sel.getNumArgs(); I != N; ++I)
+    OS << Sel.getNameForSlot(I) << ':';
+}
+
+static StringRef printSelector(Selector Sel, SmallVectorImpl<char> &Buffer) {
+  Buffer.clear();
+  llvm::raw_svector_ostream OS(Buffer);
+  printSelector(OS, Sel);
+  return OS.str();
+}
+
+static void printContainerName(raw_ostream &OS, const ObjCContainerDecl *Container) {
+  if (!Container)
+    return;
+  const ObjCInterfaceDecl *Class = NULL;
+  if (const ObjCCategoryDecl *Category = dyn_cast<ObjCCategoryDecl>(Container))
+    Class = Category->getClassInterface();
+  else if (const ObjCCategoryImplDecl *Impl = dyn_cast<ObjCCategoryImplDecl>(Container))
+    Class = Impl->getClassInterface();
+  if (Class)
+    OS << Class->getName() << '(' << Container->getName() << ')';
+  else
+    OS << Container->getName();
+}
+
+
+KeyPathValidationConsumer::~KeyPathValidationConsumer() {
+  llvm::DeleteContainerPointers(Checks);
+  llvm::DeleteContainerSeconds(AccessorTables);
+  llvm::DeleteContainerSeconds(KeyIndexes);
+}
+
+
+// Tables and resolutions reflect the declarations seen so far, which grow as
+// a streamed TU is parsed.
+void KeyPathValidationConsumer::invalidateLookupCaches() {
+  llvm::DeleteContainerSeconds(AccessorTables);
+  llvm::DeleteContainerSeconds(KeyIndexes);
+  KeyCache.clear();
+  PrefixCache.clear();
+  LookupArena.Reset();
+  Fingerprints.clear();
+  FrozenReceivers.clear();
+  InterfaceClasses.clear();
+  cacheNSTypes();
+  LookupCachesStale = false;
+}
+
+
 void KeyPathValidationConsumer::cacheNSTypes() {
   TranslationUnitDecl *TUD = Context.getTranslationUnitDecl();
 
@@ -38,7 +110,70 @@ void KeyPathValidationConsumer::cacheNSTypes() {
 }
 
 
+static void makeCacheKey(SmallVectorImpl<char> &Buffer, QualType Type, bool AllowPrivate, StringRef Key) {
+  void *TypePtr = Type.getCanonicalType().getAsOpaquePtr();
+  Buffer.clear();
+  Buffer.append(reinterpret_cast<const char *>(&TypePtr), reinterpret_cast<const char *>(&TypePtr + 1));
+  Buffer.push_back(AllowPrivate ? 'P' : '-');
+  Buffer.append(Key.begin(), Key.end());
+}
+
+
 bool KeyPathValidationConsumer::CheckKeyType(QualType &ObjTypeInOut, StringRef &Key, bool AllowPrivate) {
+  ++Stats.KeyLookups;
+  StatsTimer::Region Timing(KeyLookupTimer.get());
+
+  // Resolves to the receiver itself, sugar and all, so keep it out of the cache
+  if (Key.equals("self"))
+    return true;
+
+  SmallString<64> CacheKey;
+  makeCacheKey(CacheKey, ObjTypeInOut, AllowPrivate, Key);
+  llvm::StringMap<KeyResolution, llvm::BumpPtrAllocator &>::iterator Cached = KeyCache.find(CacheKey);
+  if (Cached != KeyCache.end()) {
+    ++Stats.KeyCacheHits;
+    if (Cached->second.Valid)
+      ObjTypeInOut = Cached->second.Type;
+    return Cached->second.Valid;
+  }
+
+  ++Stats.KeyCacheMisses;
+  QualType ResolvedType = ObjTypeInOut;
+  KeyResolution Resolution;
+  Resolution.Valid = resolveKeyType(ResolvedType, Key, AllowPrivate);
+  Resolution.Type = ResolvedType;
+  KeyCache[CacheKey] = Resolution;
+
+  if (Resolution.Valid)
+    ObjTypeInOut = ResolvedType;
+  return Resolution.Valid;
+}
+
+
+// The scalar types NSNumber has a factory method for, as accepted by
+// NSAPI::getNSNumberFactoryMethodKind. That fills in identifier caches as it
+// goes, so can't be used from resolver threads.
+static bool isNumberType(QualType Type) {
+  const BuiltinType *BT = Type->getAs<BuiltinType>();
+  if (!BT)
+    return false;
+  switch (BT->getKind()) {
+  case BuiltinType::Char_S: case BuiltinType::SChar:
+  case BuiltinType::Char_U: case BuiltinType::UChar:
+  case BuiltinType::Short: case BuiltinType::UShort:
+  case BuiltinType::Int: case BuiltinType::UInt:
+  case BuiltinType::Long: case BuiltinType::ULong:
+  case BuiltinType::LongLong: case BuiltinType::ULongLong:
+  case BuiltinType::Float: case BuiltinType::Double:
+  case BuiltinType::Bool:
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+bool KeyPathValidationConsumer::resolveKeyType(QualType &ObjTypeInOut, StringRef Key, bool AllowPrivate) {
   if (isKVCContainer(ObjTypeInOut)) {
     ObjTypeInOut = Context.getObjCIdType();
     return true;
@@ -49,71 +184,28 @@ bool KeyPathValidationConsumer::CheckKeyType(QualType &ObjTypeInOut, StringRef &
     return true; // leave ObjTypeInOut unchanged
 
 
-  std::vector<const ObjCContainerDecl *> ContainerDecls;
+  QualType Type;
   if (const ObjCObjectPointerType *ObjType = ObjTypeInOut->getAs<ObjCObjectPointerType>()) {
-    if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl()) {
-      ContainerDecls.push_back(Interface);
-    }
-    std::copy(ObjType->qual_begin(), ObjType->qual_end(), std::back_inserter(ContainerDecls));
-  }
+    const KVCAccessorTable::Entry *Accessor = NULL;
+    if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl())
+      if (const KVCAccessorTable *Table = getAccessorTable(Interface))
+        Accessor = Table->lookup(Key, AllowPrivate);
 
-  IdentifierInfo *ID = &Context.Idents.get(Key);
-  Selector Sel = Context.Selectors.getNullarySelector(ID);
-  StringRef IsKey = ("is" + Key.substr(0, 1).upper() + Key.substr(1)).str();
-  Selector IsSel = Context.Selectors.getNullarySelector(&Context.Idents.get(IsKey));
+    // Private accessors only apply to the class itself, not qualifying protocols
+    for (ObjCObjectPointerType::qual_iterator Proto = ObjType->qual_begin(), ProtoEnd = ObjType->qual_end();
+        !Accessor && Proto != ProtoEnd; ++Proto)
+      if (const KVCAccessorTable *Table = getAccessorTable(*Proto))
+        Accessor = Table->lookup(Key, false);
 
-  QualType Type;
-  for (std::vector<const ObjCContainerDecl *>::iterator Decl = ContainerDecls.begin(), DeclEnd = ContainerDecls.end();
-      Decl != DeclEnd; ++Decl) {
-	// Call the "same" (textually) method on both protocols and interfaces, not declared by the superclass
-	if (const ObjCProtocolDecl *ProtoDecl = dyn_cast<const ObjCProtocolDecl>(*Decl)) {
-	  if (const ObjCMethodDecl *Method = ProtoDecl->lookupMethod(Sel, true)) {
-		Type = Method->getResultType();
-		break;
-	  }
-	  if (const ObjCMethodDecl *Method = ProtoDecl->lookupMethod(IsSel, true)) {
-		Type = Method->getResultType();
-		break;
-	  }
-	  if (const ObjCPropertyDecl *Property = ProtoDecl->FindPropertyDeclaration(ID))
-		if (isKVCCollectionType(Property->getType())) {
-		  Type = Property->getType();
-		  break;
-		}
-	}
-	if (const ObjCInterfaceDecl *InterfaceDecl = dyn_cast<const ObjCInterfaceDecl>(*Decl)) {
-	  if (const ObjCMethodDecl *Method = InterfaceDecl->lookupMethod(Sel, true)) {
-		Type = Method->getResultType();
-		break;
-	  }
-	  if (const ObjCMethodDecl *Method = InterfaceDecl->lookupMethod(IsSel, true)) {
-		Type = Method->getResultType();
-		break;
-	  }
-	  if (const ObjCPropertyDecl *Property = InterfaceDecl->FindPropertyDeclaration(ID))
-		if (isKVCCollectionType(Property->getType())) {
-		  Type = Property->getType();
-		  break;
-		}
-
-      if (AllowPrivate) {
-        if (const ObjCMethodDecl *Method = InterfaceDecl->lookupPrivateMethod(Sel, true)) {
-          Type = Method->getResultType();
-          break;
-        }
-        if (const ObjCMethodDecl *Method = InterfaceDecl->lookupPrivateMethod(IsSel, true)) {
-          Type = Method->getResultType();
-          break;
-        }
-      }
-	}
+    if (Accessor)
+      Type = Accessor->Type;
   }
   if (Type.isNull())
     return false;
 
   if (Type->isObjCObjectPointerType())
 	ObjTypeInOut = Type;
-  else if (NSAPIObj->getNSNumberFactoryMethodKind(Type).hasValue())
+  else if (isNumberType(Type))
 	ObjTypeInOut = NSNumberPtrType;
 
   // TODO: Primitives to NSValue
@@ -121,6 +213,371 @@ bool KeyPathValidationConsumer::CheckKeyType(QualType &ObjTypeInOut, StringRef &
 }
 
 
+const KVCAccessorTable *KeyPathValidationConsumer::getAccessorTable(const ObjCContainerDecl *Container) {
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container))
+    Container = Interface->getDefinition();
+  else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(Container))
+    Container = Protocol->getDefinition();
+  if (!Container)
+    return NULL;
+
+  llvm::DenseMap<const ObjCContainerDecl *, KVCAccessorTable *>::iterator Cached = AccessorTables.find(Container);
+  if (Cached != AccessorTables.end())
+    return Cached->second;
+
+  // Registered before it's filled in, so invalid cyclic code terminates
+  KVCAccessorTable *Table = new KVCAccessorTable;
+  AccessorTables[Container] = Table;
+
+  // The container's own accessors come from the summary if it has them;
+  // what it inherits is merged in either way
+  SmallVector<const ObjCContainerDecl *, 8> Inherited;
+  if (!loadAccessorTable(Table, Container, Inherited))
+    addOwnAccessors(Table, Container, Inherited);
+  for (SmallVectorImpl<const ObjCContainerDecl *>::const_iterator I = Inherited.begin(), IEnd = Inherited.end(); I != IEnd; ++I)
+    if (const KVCAccessorTable *InheritedTable = getAccessorTable(*I))
+      Table->mergeFrom(*InheritedTable);
+
+  QualType OrderedProxyType = Context.getObjCIdType(), UnorderedProxyType = Context.getObjCIdType();
+  if (NSArrayInterface)
+    OrderedProxyType = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(NSArrayInterface));
+  if (NSSetInterface)
+    UnorderedProxyType = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(NSSetInterface));
+  Table->addCollectionAccessors(OrderedProxyType, UnorderedProxyType);
+
+  return Table;
+}
+
+
+// Adds what the container and its categories and @implementations declare,
+// and lists the protocols and superclass it inherits from, in the order they
+// are merged. Merging keeps the best accessor for each key, so it doesn't
+// matter that their tables are merged after all of these are added.
+void KeyPathValidationConsumer::addOwnAccessors(KVCAccessorTable *Table, const ObjCContainerDecl *Container, SmallVectorImpl<const ObjCContainerDecl *> &Inherited) {
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container)) {
+    addContainerAccessors(Table, Interface, false);
+    for (ObjCInterfaceDecl::ivar_iterator Ivar = Interface->ivar_begin(), IvarEnd = Interface->ivar_end();
+        Ivar != IvarEnd; ++Ivar)
+      Table->addIvar(*Ivar, false);
+
+    for (ObjCInterfaceDecl::visible_categories_iterator Category = Interface->visible_categories_begin(), CategoryEnd = Interface->visible_categories_end();
+        Category != CategoryEnd; ++Category) {
+      addContainerAccessors(Table, *Category, false);
+      for (ObjCCategoryDecl::ivar_iterator Ivar = Category->ivar_begin(), IvarEnd = Category->ivar_end();
+          Ivar != IvarEnd; ++Ivar)
+        Table->addIvar(*Ivar, true);
+      if (const ObjCCategoryImplDecl *CategoryImpl = Category->getImplementation())
+        addContainerAccessors(Table, CategoryImpl, true);
+      Inherited.append(Category->protocol_begin(), Category->protocol_end());
+    }
+
+    if (const ObjCImplementationDecl *Impl = Interface->getImplementation()) {
+      addContainerAccessors(Table, Impl, true);
+      for (ObjCImplementationDecl::ivar_iterator Ivar = Impl->ivar_begin(), IvarEnd = Impl->ivar_end();
+          Ivar != IvarEnd; ++Ivar)
+        Table->addIvar(*Ivar, true);
+    }
+
+    Inherited.append(Interface->all_referenced_protocol_begin(), Interface->all_referenced_protocol_end());
+    if (const ObjCInterfaceDecl *Super = Interface->getSuperClass())
+      Inherited.push_back(Super);
+
+  } else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(Container)) {
+    addContainerAccessors(Table, Protocol, false);
+    Inherited.append(Protocol->protocol_begin(), Protocol->protocol_end());
+  }
+}
+
+
+void KeyPathValidationConsumer::loadSummary() {
+  if (Options.SummaryInPath.empty())
+    return;
+
+  // No summary (e.g. the PCH was built without the plug-in) just means
+  // building the tables from the AST
+  Summary = KVCSummary::loadShared(Options.SummaryInPath);
+  if (Summary)
+    SummaryTypes.assign(Summary->getNumTypes(), QualType());
+}
+
+
+// Summarizes every interface and protocol defined in this TU; when building
+// a PCH, that's everything TUs including it will see.
+void KeyPathValidationConsumer::writeSummary() {
+  KVCSummaryWriter Writer;
+  TranslationUnitDecl *TUD = Context.getTranslationUnitDecl();
+  for (DeclContext::decl_iterator D = TUD->decls_begin(), DEnd = TUD->decls_end(); D != DEnd; ++D) {
+    const ObjCContainerDecl *Container = NULL;
+    unsigned Flags = 0;
+    if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(*D)) {
+      if (!Interface->isThisDeclarationADefinition())
+        continue;
+      QualType Type = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(Interface));
+      if (isKVCContainer(Type))
+        Flags |= KVCSummary::CF_KVCContainer;
+      if (isKVCCollectionType(Type))
+        Flags |= KVCSummary::CF_KVCCollection;
+      Container = Interface;
+    } else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(*D)) {
+      if (!Protocol->isThisDeclarationADefinition())
+        continue;
+      Flags |= KVCSummary::CF_Protocol;
+      Container = Protocol;
+    } else
+      continue;
+
+    // Only what the container declares itself; readers merge in what it
+    // inherits, as getAccessorTable does
+    KVCAccessorTable OwnTable;
+    SmallVector<const ObjCContainerDecl *, 8> Inherited;
+    addOwnAccessors(&OwnTable, Container, Inherited);
+    const KVCAccessorTable *Table = &OwnTable;
+
+    SmallString<32> Stamp;
+    getSummaryStamp(Container, Stamp);
+    StringRef SuperName;
+    std::vector<std::string> ProtocolNames;
+    for (SmallVectorImpl<const ObjCContainerDecl *>::const_iterator I = Inherited.begin(), IEnd = Inherited.end(); I != IEnd; ++I) {
+      if (isa<ObjCInterfaceDecl>(*I))
+        SuperName = (*I)->getName();
+      else
+        ProtocolNames.push_back((*I)->getName().str());
+    }
+    Writer.addContainer(Container->getName(), Flags, Stamp, SuperName, ProtocolNames);
+    for (KVCAccessorTable::slot_iterator Slot = Table->slot_begin(), SlotEnd = Table->slot_end(); Slot != SlotEnd; ++Slot) {
+      KVCSummary::Entry E;
+      E.Key = Slot->getKey();
+      E.PublicKind = Slot->second.Public.Kind;
+      E.AnyKind = Slot->second.Any.Kind;
+      E.PublicCollectionParts = E.AnyCollectionParts = 0;
+      E.PublicType = addSummaryType(Writer, Slot->second.Public.Type);
+      E.AnyType = addSummaryType(Writer, Slot->second.Any.Type);
+      Writer.addEntry(E);
+    }
+    // Kept so a subclass can complete a collection accessor pattern
+    for (KVCAccessorTable::collection_iterator Collection = Table->collection_begin(), CollectionEnd = Table->collection_end();
+        Collection != CollectionEnd; ++Collection) {
+      KVCSummary::Entry E;
+      E.Key = Collection->getKey();
+      E.PublicKind = E.AnyKind = KVCAccessorTable::AK_None;
+      E.PublicCollectionParts = Collection->second.Public;
+      E.AnyCollectionParts = Collection->second.Any;
+      E.PublicType = E.AnyType = KVCSummary::NoIndex;
+      Writer.addEntry(E);
+    }
+  }
+
+  std::string Error;
+  if (!Writer.write(Options.SummaryOutPath, Error)) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write key path summary '%0': %1")) << Options.SummaryOutPath << Error;
+  }
+}
+
+
+uint32_t KeyPathValidationConsumer::addSummaryType(KVCSummaryWriter &Writer, QualType Type) {
+  if (Type.isNull())
+    return KVCSummary::NoIndex;
+
+  if (const ObjCObjectPointerType *ObjType = Type->getAs<ObjCObjectPointerType>()) {
+    if (ObjType->isObjCClassType() || ObjType->isObjCQualifiedClassType())
+      return Writer.addType(KVCSummary::TT_Class, StringRef(), ArrayRef<std::string>());
+
+    StringRef InterfaceName;
+    if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl())
+      InterfaceName = Interface->getName();
+    std::vector<std::string> ProtocolNames;
+    for (ObjCObjectPointerType::qual_iterator Proto = ObjType->qual_begin(), ProtoEnd = ObjType->qual_end();
+        Proto != ProtoEnd; ++Proto)
+      ProtocolNames.push_back((*Proto)->getName().str());
+    return Writer.addType(KVCSummary::TT_Object, InterfaceName, ProtocolNames);
+  }
+
+  if (isNumberType(Type))
+    return Writer.addType(KVCSummary::TT_Number, StringRef(), ArrayRef<std::string>());
+  return Writer.addType(KVCSummary::TT_Other, StringRef(), ArrayRef<std::string>());
+}
+
+
+// Categories and @implementations in this TU add keys to a class that the
+// summary can't know about. Those of its superclasses are checked when their
+// own tables are built.
+bool KeyPathValidationConsumer::isSummaryCurrent(const ObjCContainerDecl *Container) {
+  if (!Container->isFromASTFile())
+    return false;
+
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container)) {
+    if (Interface->getImplementation())
+      return false;
+    for (ObjCInterfaceDecl::visible_categories_iterator Category = Interface->visible_categories_begin(), CategoryEnd = Interface->visible_categories_end();
+        Category != CategoryEnd; ++Category)
+      if (!Category->isFromASTFile())
+        return false;
+  }
+  return true;
+}
+
+
+// Fills in the container's own accessors, and lists what it inherits from
+// the names the summary gives.
+bool KeyPathValidationConsumer::loadAccessorTable(KVCAccessorTable *Table, const ObjCContainerDecl *Container, SmallVectorImpl<const ObjCContainerDecl *> &Inherited) {
+  if (!Summary || !isSummaryCurrent(Container))
+    return false;
+
+  // The entries are decoded once per summary, which a server keeps loaded
+  // across requests; only their types are bound to this TU's ASTContext
+  const KVCSummary::DecodedContainer *Decoded = Summary->getDecodedContainer(Container->getName(), isa<ObjCProtocolDecl>(Container));
+  if (!Decoded)
+    return false;
+  SmallString<32> Stamp;
+  getSummaryStamp(Container, Stamp);
+  if (Decoded->Stamp != Stamp.str())
+    return false;
+
+  const std::vector<KVCSummary::Entry> &Entries = Decoded->Entries;
+  for (std::vector<KVCSummary::Entry>::const_iterator Entry = Entries.begin(), EntryEnd = Entries.end(); Entry != EntryEnd; ++Entry) {
+    const KVCSummary::Entry &E = *Entry;
+    if (E.PublicKind < KVCAccessorTable::AK_None || E.AnyKind < KVCAccessorTable::AK_None) {
+      KVCAccessorTable::Slot S;
+      if (E.PublicKind < KVCAccessorTable::AK_None) {
+        S.Public.Kind = KVCAccessorTable::AccessorKind(E.PublicKind);
+        S.Public.Type = getSummaryType(E.PublicType);
+      }
+      if (E.AnyKind < KVCAccessorTable::AK_None) {
+        S.Any.Kind = KVCAccessorTable::AccessorKind(E.AnyKind);
+        S.Any.Type = getSummaryType(E.AnyType);
+      }
+      Table->setSlot(E.Key, S);
+    }
+
+    if (E.PublicCollectionParts || E.AnyCollectionParts) {
+      KVCAccessorTable::CollectionParts Parts;
+      Parts.Public = E.PublicCollectionParts;
+      Parts.Any = E.AnyCollectionParts;
+      Table->setCollectionParts(E.Key, Parts);
+    }
+  }
+
+  for (std::vector<StringRef>::const_iterator Name = Decoded->Protocols.begin(), NameEnd = Decoded->Protocols.end(); Name != NameEnd; ++Name)
+    if (NamedDecl *Protocol = lookupTopLevel(*Name, Decl::ObjCProtocol))
+      Inherited.push_back(cast<ObjCProtocolDecl>(Protocol));
+  if (!Decoded->SuperClass.empty())
+    if (NamedDecl *Super = lookupTopLevel(Decoded->SuperClass, Decl::ObjCInterface))
+      Inherited.push_back(cast<ObjCInterfaceDecl>(Super));
+
+  ++Stats.SummaryTablesLoaded;
+  return true;
+}
+
+
+// Summary types are stand-ins that resolveKeyType treats the same way as the
+// originals: numbers become int, other non-objects void.
+QualType KeyPathValidationConsumer::getSummaryType(uint32_t Index) {
+  if (Index >= SummaryTypes.size())
+    return QualType();
+  if (!SummaryTypes[Index].isNull())
+    return SummaryTypes[Index];
+
+  QualType Type;
+  StringRef InterfaceName;
+  SmallVector<StringRef, 4> ProtocolNames;
+  switch (Summary->getType(Index, InterfaceName, ProtocolNames)) {
+  case KVCSummary::TT_Number:
+    Type = Context.IntTy;
+    break;
+  case KVCSummary::TT_Other:
+    Type = Context.VoidTy;
+    break;
+  case KVCSummary::TT_Class:
+    Type = Context.getObjCClassType();
+    break;
+  case KVCSummary::TT_Object: {
+    QualType Base = Context.ObjCBuiltinIdTy;
+    if (!InterfaceName.empty())
+      if (NamedDecl *Interface = lookupTopLevel(InterfaceName, Decl::ObjCInterface))
+        Base = Context.getObjCInterfaceType(cast<ObjCInterfaceDecl>(Interface));
+
+    SmallVector<ObjCProtocolDecl *, 4> Protocols;
+    for (SmallVectorImpl<StringRef>::const_iterator Name = ProtocolNames.begin(), NameEnd = ProtocolNames.end();
+        Name != NameEnd; ++Name)
+      if (NamedDecl *Protocol = lookupTopLevel(*Name, Decl::ObjCProtocol))
+        Protocols.push_back(cast<ObjCProtocolDecl>(Protocol));
+    if (!Protocols.empty())
+      Base = Context.getObjCObjectType(Base, Protocols.data(), Protocols.size());
+    Type = Context.getObjCObjectPointerType(Base);
+    break;
+  }
+  }
+
+  SummaryTypes[Index] = Type;
+  return Type;
+}
+
+
+NamedDecl *KeyPathValidationConsumer::lookupTopLevel(StringRef Name, Decl::Kind Kind) {
+  DeclContext::lookup_result R = Context.getTranslationUnitDecl()->lookup(&Context.Idents.get(Name));
+  for (DeclContext::lookup_iterator D = R.begin(), DEnd = R.end(); D != DEnd; ++D)
+    if ((*D)->getKind() == Kind)
+      return *D;
+  return NULL;
+}
+
+
+void KeyPathValidationConsumer::addContainerAccessors(KVCAccessorTable *Table, const ObjCContainerDecl *Container, bool Private) {
+  for (ObjCContainerDecl::instmeth_iterator Method = Container->instmeth_begin(), MethodEnd = Container->instmeth_end();
+      Method != MethodEnd; ++Method)
+    Table->addMethod(*Method, Private);
+
+  if (Private)
+    return;
+  for (ObjCContainerDecl::prop_iterator Property = Container->prop_begin(), PropertyEnd = Container->prop_end();
+      Property != PropertyEnd; ++Property)
+    if (isKVCCollectionType(Property->getType()))
+      Table->addCollectionProperty(*Property);
+}
+
+
+// Classes missing when Foundation isn't imported match nothing
+static bool isSameInterface(const ObjCInterfaceDecl *Interface, const ObjCInterfaceDecl *Other) {
+  return Interface && Other && Interface->getCanonicalDecl() == Other->getCanonicalDecl();
+}
+
+
+// Computed once per class, on top of its superclass's, rather than walking
+// the hierarchy for every key.
+unsigned KeyPathValidationConsumer::getInterfaceClass(const ObjCInterfaceDecl *Interface) {
+  if (!Interface)
+    return 0;
+  if (const ObjCInterfaceDecl *Definition = Interface->getDefinition())
+    Interface = Definition;
+
+  llvm::DenseMap<const ObjCInterfaceDecl *, unsigned>::const_iterator Cached = InterfaceClasses.find(Interface);
+  if (Cached != InterfaceClasses.end())
+    return Cached->second;
+  // Registered before it's computed, so invalid cyclic code terminates
+  InterfaceClasses[Interface] = 0;
+
+  // Foundation built-ins
+  unsigned Class = 0;
+  if (isSameInterface(Interface, NSArrayInterface) || isSameInterface(Interface, NSOrderedSetInterface))
+    Class = IC_Container | IC_Collection | IC_Ordered;
+  else if (isSameInterface(Interface, NSSetInterface))
+    Class = IC_Container | IC_Collection;
+  else if (isSameInterface(Interface, NSDictionaryInterface))
+    Class = IC_Container;
+
+  for (Decl::attr_iterator Attr = Interface->attr_begin(), AttrEnd = Interface->attr_end();
+      Attr != AttrEnd; ++Attr)
+    if (const AnnotateAttr *AA = dyn_cast<AnnotateAttr>(*Attr))
+      if (AA->getAnnotation().equals("objc_kvc_container"))
+        Class |= IC_Container | IC_Annotated;
+
+  Class |= getInterfaceClass(Interface->getSuperClass());
+  InterfaceClasses[Interface] = Class;
+  return Class;
+}
+
+
 bool KeyPathValidationConsumer::isKVCContainer(QualType Type) {
   if (Type->isObjCIdType())
     return true;
@@ -128,26 +585,7 @@ bool KeyPathValidationConsumer::isKVCContainer(QualType Type) {
   const ObjCInterfaceDecl *ObjInterface = NULL;
   if (const ObjCObjectPointerType *ObjPointerType = Type->getAsObjCInterfacePointerType())
     ObjInterface = ObjPointerType->getInterfaceDecl();
-
-  // Foundation built-ins
-  if (NSDictionaryInterface->isSuperClassOf(ObjInterface) ||
-      NSArrayInterface->isSuperClassOf(ObjInterface) ||
-      NSSetInterface ->isSuperClassOf(ObjInterface)||
-      NSOrderedSetInterface->isSuperClassOf(ObjInterface))
-    return true;
-
-  // Check for attribute
-  while (ObjInterface) {
-    for (Decl::attr_iterator Attr = ObjInterface->attr_begin(), AttrEnd = ObjInterface->attr_end();
-        Attr != AttrEnd; ++Attr) {
-      if (AnnotateAttr *AA = dyn_cast<AnnotateAttr>(*Attr))
-        if (AA->getAnnotation().equals("objc_kvc_container"))
-          return true;
-    }
-
-    ObjInterface = ObjInterface->getSuperClass();
-  }
-  return false;
+  return getInterfaceClass(ObjInterface) & IC_Container;
 }
 
 
@@ -155,10 +593,7 @@ bool KeyPathValidationConsumer::isKVCCollectionType(QualType Type) {
   const ObjCInterfaceDecl *ObjInterface = NULL;
   if (const ObjCObjectPointerType *ObjPointerType = Type->getAsObjCInterfacePointerType())
     ObjInterface = ObjPointerType->getInterfaceDecl();
-
-  return (NSArrayInterface->isSuperClassOf(ObjInterface) ||
-		  NSSetInterface->isSuperClassOf(ObjInterface) ||
-		  NSOrderedSetInterface->isSuperClassOf(ObjInterface));
+  return getInterfaceClass(ObjInterface) & IC_Collection;
 }
 
 
@@ -172,31 +607,930 @@ void KeyPathValidationConsumer::emitDiagnosticsForTypeAndMaybeReceiverAndKeyPath
   if (ModelExpr)
     ModelRange = ModelExpr->getSourceRange();
 
+  BudgetState State = chargeBudget(KeyPathExpr);
+  if (State == BS_Stopped)
+    return;
+  if (!Replaying)
+    ++Stats.KeyPathsValidated;
+  StringRef KeyPath = KeyPathLiteral->getString()->getString();
+  if (State == BS_Degraded)
+    KeyPath = KeyPath.split('.').first;
+  else if (Options.WriteManifest && !Replaying)
+    noteManifestKeyPath(Type, KeyPath, AllowPrivate, /*SingleKey=*/false);
+  if (Options.ResolverThreads > 1) {
+    SmallString<256> SiteKey;
+    if (Results)
+      makeSiteKey(SiteKey, Type, ModelExpr, KeyPathExpr, KeyPath, AllowPrivate);
+    addPendingKeyPath(Type, ModelRange, KeyPath, KeyPathExpr->getSourceRange(), AllowPrivate, /*SingleKey=*/false, SiteKey);
+    return;
+  }
+
   QualType ObjType = Type;
   size_t Offset = 2; // @"
+  StringRef Remaining = KeyPath;
+
+  SmallString<256> SiteKey;
+  ResultCache::Result Result;
+  if (Results) {
+    makeSiteKey(SiteKey, Type, ModelExpr, KeyPathExpr, KeyPath, AllowPrivate);
+    if (Results->lookup(SiteKey, Result) && areDependenciesCurrent(Result.Dependencies) &&
+        (Result.Valid || Result.KeyOffset >= 2) && Result.KeyOffset + Result.KeyLength <= KeyPath.size() + 2) {
+      ++Stats.ResultCacheHits;
+      if (!Result.Valid) {
+        StringRef Key = KeyPath.substr(Result.KeyOffset - 2, Result.KeyLength);
+        reportInvalidKey(KeyPath, Key, Result.TypeName, resolveKeyReceiver(Type, KeyPath, Key, AllowPrivate), AllowPrivate,
+                         ModelRange, KeyPathExpr->getSourceRange(), Result.KeyOffset, CurrentCheck, CurrentSend, CurrentContainer);
+      }
+      return;
+    }
+    ++Stats.ResultCacheMisses;
+    Result = ResultCache::Result();
+  }
+
+  // Resume after the longest prefix (possibly the whole path) already resolved.
+  // A result to be stored needs the receiver of every key, so walks them all.
+  SmallString<128> CacheKey;
+  bool PrefixHit = false;
+  for (size_t PrefixEnd = KeyPath.size(); !Results && PrefixEnd != StringRef::npos && PrefixEnd > 0; PrefixEnd = KeyPath.rfind('.', PrefixEnd)) {
+    makeCacheKey(CacheKey, Type, AllowPrivate, KeyPath.substr(0, PrefixEnd));
+    llvm::StringMap<QualType, llvm::BumpPtrAllocator &>::iterator Cached = PrefixCache.find(CacheKey);
+    if (Cached == PrefixCache.end())
+      continue;
+    ObjType = Cached->second;
+    Remaining = PrefixEnd < KeyPath.size() ? KeyPath.substr(PrefixEnd + 1) : StringRef();
+    Offset += PrefixEnd + 1;
+    PrefixHit = true;
+    break;
+  }
+  // Lookups that skipped the prefix cache count as neither
+  if (PrefixHit)
+    ++Stats.PrefixCacheHits;
+  else if (!Results)
+    ++Stats.PrefixCacheMisses;
+
   typedef std::pair<StringRef,StringRef> StringPair;
-  for (StringPair KeyAndPath = KeyPathLiteral->getString()->getString().split('.'); KeyAndPath.first.size() > 0; KeyAndPath = KeyAndPath.second.split('.')) {
+  for (StringPair KeyAndPath = Remaining.split('.'); KeyAndPath.first.size() > 0; KeyAndPath = KeyAndPath.second.split('.')) {
     StringRef Key = KeyAndPath.first;
-    bool Valid = emitDiagnosticsForTypeAndMaybeReceiverAndKey(ObjType, ModelRange, Key, KeyPathExpr->getSourceRange(), Offset, AllowPrivate);
-    if (!Valid)
+    if (Results)
+      addDependencies(ObjType, Result.Dependencies);
+    bool Valid = emitDiagnosticsForTypeAndMaybeReceiverAndKey(ObjType, ModelRange, KeyPath, Key, KeyPathExpr->getSourceRange(), Offset, AllowPrivate);
+    if (!Valid) {
+      Result.Valid = false;
+      Result.KeyOffset = Offset;
+      Result.KeyLength = Key.size();
+      Result.TypeName = ObjType->getPointeeType().getAsString();
       break;
+    }
     Offset += Key.size() + 1;
+
+    makeCacheKey(CacheKey, Type, AllowPrivate, KeyPath.substr(0, Offset - 3));
+    PrefixCache[CacheKey] = ObjType;
   }
+
+  // A deferred result isn't final
+  if (Results && !InvalidKeyDeferred)
+    Results->store(SiteKey, Result);
 }
 
-bool KeyPathValidationConsumer::emitDiagnosticsForTypeAndMaybeReceiverAndKey(QualType &ObjTypeInOut, SourceRange ModelRange, StringRef Key, SourceRange KeyRange, size_t Offset, bool AllowPrivate) {
+bool KeyPathValidationConsumer::resolveKeyPath(QualType Type, StringRef KeyPath, bool AllowPrivate, SmallVectorImpl<ResolvedKey> &Keys) {
+  typedef std::pair<StringRef,StringRef> StringPair;
+  for (StringPair KeyAndPath = KeyPath.split('.'); KeyAndPath.first.size() > 0; KeyAndPath = KeyAndPath.second.split('.')) {
+    ResolvedKey Resolved;
+    Resolved.Key = KeyAndPath.first;
+    Resolved.Receiver = Type;
+    if (!CheckKeyType(Type, Resolved.Key, AllowPrivate))
+      return false;
+    Resolved.Type = Type;
+    Keys.push_back(Resolved);
+  }
+  return true;
+}
+
+
+bool KeyPathValidationConsumer::emitDiagnosticsForTypeAndMaybeReceiverAndKey(QualType &ObjTypeInOut, SourceRange ModelRange, StringRef KeyPath, StringRef Key, SourceRange KeyRange, size_t Offset, bool AllowPrivate) {
   bool Valid = CheckKeyType(ObjTypeInOut, Key, AllowPrivate);
   if (Valid)
     return Valid;
 
+  SmallString<64> TypeName;
+  printType(ObjTypeInOut->getPointeeType(), Context.getPrintingPolicy(), TypeName);
+  reportInvalidKey(KeyPath, Key, TypeName, ObjTypeInOut, AllowPrivate, ModelRange, KeyRange, Offset, CurrentCheck, CurrentSend, CurrentContainer);
+  return Valid;
+}
+
+
+void KeyPathValidationConsumer::reportInvalidKey(StringRef KeyPath, StringRef Key, StringRef TypeName, QualType Receiver, bool AllowPrivate,
+                                                 SourceRange ModelRange, SourceRange KeyRange, size_t Offset,
+                                                 const KeyPathValidationCheck *Check, const ObjCMessageExpr *Send, const Decl *Container) {
+  if (DeferInvalidKeys) {
+    InvalidKeyDeferred = true;
+    InvalidKeyDeferredOverBudget = Budget != BS_Within;
+    return;
+  }
+
+  ++Stats.DiagnosticsEmitted;
   SourceLocation KeyStart = KeyRange.getBegin().getLocWithOffset(Offset);
   KeyRange.setBegin(KeyStart);
   KeyRange.setEnd(KeyStart.getLocWithOffset(1));
 
-  DiagnosticBuilder DB = Compiler.getDiagnostics().Report(KeyStart, KeyDiagID);
-  DB << Key << ObjTypeInOut->getPointeeType().getAsString() << KeyRange;
-  if (ModelRange.isValid())
-    DB << ModelRange;
+  // The literal can only be edited where it's spelled
+  StringRef Suggestion = suggestKey(Receiver, Key, AllowPrivate);
+  FixItHint FixIt;
+  if (!Suggestion.empty() && KeyStart.isFileID())
+    FixIt = FixItHint::CreateReplacement(CharSourceRange::getCharRange(KeyStart, KeyStart.getLocWithOffset(Key.size())), Suggestion);
 
-  return Valid;
+  if (!Collected) {
+    DiagnosticBuilder DB = Compiler.getDiagnostics().Report(KeyStart, Suggestion.empty() ? KeyDiagID : KeySuggestionDiagID);
+    DB << Key << TypeName;
+    if (!Suggestion.empty())
+      DB << Suggestion;
+    DB << KeyRange;
+    if (ModelRange.isValid())
+      DB << ModelRange;
+    if (!FixIt.isNull())
+      DB << FixIt;
+  }
+
+  if (!Findings && !Collected)
+    return;
+  SmallString<64> Selector, ContainerName;
+  SmallString<128> Message;
+  ("key '" + Key + "' not found on type " + TypeName).toVector(Message);
+  if (!Suggestion.empty())
+    ("; did you mean '" + Suggestion + "'?").toVector(Message);
+  FindingsWriter::Finding F;
+  F.Kind = "invalid-key";
+  F.Check = Check ? Check->getName() : "";
+  if (Send)
+    F.Selector = printSelector(Send->getSelector(), Selector);
+  F.KeyPath = KeyPath;
+  F.Key = Key;
+  // Key is always a piece of KeyPath
+  F.KeyOffset = Key.data() >= KeyPath.data() && Key.data() <= KeyPath.end() ? Key.data() - KeyPath.data() : 0;
+  F.ReceiverType = TypeName;
+  F.Container = getContainerName(Container, ContainerName);
+  F.Message = Message;
+  addFinding(F, KeyStart, KeyRange);
+  if (Collected)
+    Collected->back().FixIt = FixIt;
+}
+
+
+// Result cache hits only record the name of the type the invalid key was
+// looked up on; the type itself is wanted for suggestions.
+QualType KeyPathValidationConsumer::resolveKeyReceiver(QualType Type, StringRef KeyPath, StringRef Key, bool AllowPrivate) {
+  SmallVector<ResolvedKey, 4> Keys;
+  if (!resolveKeyPath(Type, KeyPath.substr(0, Key.data() - KeyPath.data()), AllowPrivate, Keys))
+    return QualType();
+  return Keys.empty() ? Type : Keys.back().Type;
+}
+
+
+// Looked for only once a key is known to be invalid, so valid code never
+// pays for it. As with clang's typo correction, up to a third of the key
+// may be wrong.
+StringRef KeyPathValidationConsumer::suggestKey(QualType Receiver, StringRef Key, bool AllowPrivate) {
+  if (Receiver.isNull() || Key.empty() || Key.find('.') != StringRef::npos)
+    return StringRef();
+  const ObjCObjectPointerType *ObjType = Receiver->getAs<ObjCObjectPointerType>();
+  if (!ObjType)
+    return StringRef();
+
+  // Private keys only apply to the class itself, as in resolveKeyType
+  SmallVector<std::pair<const KVCAccessorTable *, bool>, 4> Tables;
+  if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl())
+    if (const KVCAccessorTable *Table = getAccessorTable(Interface))
+      Tables.push_back(std::make_pair(Table, AllowPrivate));
+  for (ObjCObjectPointerType::qual_iterator Proto = ObjType->qual_begin(), ProtoEnd = ObjType->qual_end(); Proto != ProtoEnd; ++Proto)
+    if (const KVCAccessorTable *Table = getAccessorTable(*Proto))
+      Tables.push_back(std::make_pair(Table, false));
+
+  StringRef Nearest;
+  unsigned Distance = (Key.size() + 2) / 3 + 1;
+  for (SmallVectorImpl<std::pair<const KVCAccessorTable *, bool> >::const_iterator T = Tables.begin(), TEnd = Tables.end(); T != TEnd; ++T) {
+    NearestKeyIndex *&Index = KeyIndexes[T->first];
+    if (!Index)
+      Index = new NearestKeyIndex(*T->first);
+    Index->findNearest(Key, T->second, Nearest, Distance);
+  }
+  return Nearest;
+}
+
+
+void KeyPathValidationConsumer::noteAffectingKeyPath(const ObjCMethodDecl *Method, const ObjCStringLiteral *KeyPath) {
+  if ((Options.WriteKVOGraph || Options.WriteManifest) && Method->getClassInterface()) {
+    AffectingKeyPath Affecting = { Method, KeyPath->getString()->getString() };
+    AffectingKeyPaths.push_back(Affecting);
+  }
+  // Visits replayed after streaming note the same key paths again, but
+  // findings and graph edges are only kept once
+  if (!Findings && !Collected)
+    return;
+  std::string Selector = Method->getSelector().getAsString();
+  StringRef KeyPathString = KeyPath->getString()->getString();
+  std::string ClassName = Method->getClassInterface() ? Method->getClassInterface()->getName().str() : std::string();
+  std::string Message = (Twine("+") + Selector + " returns key path '" + KeyPathString + "'").str();
+  FindingsWriter::Finding F;
+  F.Kind = "affecting-key-path";
+  F.Check = CurrentCheck ? CurrentCheck->getName() : "";
+  F.Selector = Selector;
+  F.KeyPath = KeyPathString;
+  F.ReceiverType = ClassName;
+  SmallString<64> ContainerName;
+  F.Container = getContainerName(CurrentContainer, ContainerName);
+  F.Message = Message;
+  addFinding(F, KeyPath->getLocStart(), KeyPath->getSourceRange());
+}
+
+
+// keyPathsForValuesAffectingFullName is for "fullName", but
+// keyPathsForValuesAffectingURL is for "URL". Empty for other methods.
+static StringRef getAffectedKey(const ObjCMethodDecl *Method, SmallVectorImpl<char> &Key) {
+  static const char Prefix[] = "keyPathsForValuesAffecting";
+  StringRef Name = Method->getSelector().getNameForSlot(0);
+  if (!Name.startswith(Prefix) || Name.size() == sizeof(Prefix) - 1)
+    return StringRef();
+
+  StringRef Capitalized = Name.substr(sizeof(Prefix) - 1);
+  Key.assign(Capitalized.begin(), Capitalized.end());
+  if (Key.size() == 1 || !isUppercase(Key[1]))
+    Key[0] = toLowercase(Key[0]);
+  return StringRef(Key.data(), Key.size());
+}
+
+
+// Resolved here rather than as methods are visited, so that keys declared
+// further down the TU (while streaming) are found.
+void KeyPathValidationConsumer::writeKVOGraph() {
+  KVODependencyGraph Graph;
+  SmallString<32> AffectedKeyBuffer;
+  for (std::vector<AffectingKeyPath>::const_iterator Affecting = AffectingKeyPaths.begin(), AffectingEnd = AffectingKeyPaths.end();
+      Affecting != AffectingEnd; ++Affecting) {
+    const ObjCInterfaceDecl *Class = Affecting->Method->getClassInterface();
+    StringRef AffectedKey = getAffectedKey(Affecting->Method, AffectedKeyBuffer);
+    if (AffectedKey.empty())
+      continue;
+
+    QualType Type = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(Class));
+    SmallVector<ResolvedKey, 4> Keys;
+    bool Valid = resolveKeyPath(Type, Affecting->KeyPath, /*AllowPrivate=*/true, Keys);
+
+    SmallVector<KVODependencyGraph::Step, 4> Steps;
+    for (SmallVectorImpl<ResolvedKey>::const_iterator Key = Keys.begin(), KeyEnd = Keys.end(); Key != KeyEnd; ++Key) {
+      if (Key->Key == "self")
+        continue;
+      KVODependencyGraph::Step S;
+      // Containers answer any key, so there's no class to attach it to
+      if (const ObjCObjectPointerType *Receiver = Key->Receiver->getAsObjCInterfacePointerType())
+        if (!isKVCContainer(Key->Receiver))
+          S.Class = Receiver->getInterfaceDecl()->getName();
+      S.Key = Key->Key;
+      S.ToMany = isKVCCollectionType(Key->Type);
+      Steps.push_back(S);
+    }
+    Graph.addDependency(Class->getName(), AffectedKey, Affecting->KeyPath, Valid, Steps);
+  }
+
+  std::string Error;
+  llvm::raw_fd_ostream OS(Options.KVOGraphPath.c_str(), Error, llvm::sys::fs::F_None);
+  if (Error.empty()) {
+    const SourceManager &SM = Context.getSourceManager();
+    const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+    Graph.writeJSON(OS, MainFile ? MainFile->getName() : "");
+  }
+  if (!Error.empty() || OS.has_error()) {
+    OS.clear_error();
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write KVO dependency graph '%0'")) << Options.KVOGraphPath;
+  }
+}
+
+
+// A single key containing a dot can't be written as a key path
+void KeyPathValidationConsumer::noteManifestKeyPath(QualType Type, StringRef KeyPath, bool AllowPrivate, bool SingleKey) {
+  if (SingleKey && KeyPath.find('.') != StringRef::npos)
+    return;
+  ManifestKeyPath M = { Type, KeyPath, AllowPrivate };
+  ManifestKeyPaths.push_back(M);
+}
+
+
+// Like the KVO graph, resolved once the whole TU has been seen. Only key
+// paths that start from a known class and resolve are written.
+void KeyPathValidationConsumer::writeManifest() {
+  KeyPathManifestWriter Writer;
+  for (std::vector<ManifestKeyPath>::const_iterator M = ManifestKeyPaths.begin(), MEnd = ManifestKeyPaths.end(); M != MEnd; ++M)
+    addManifestKeyPath(Writer, M->Type, M->KeyPath, M->AllowPrivate, StringRef());
+
+  SmallString<32> AffectedKeyBuffer;
+  for (std::vector<AffectingKeyPath>::const_iterator Affecting = AffectingKeyPaths.begin(), AffectingEnd = AffectingKeyPaths.end();
+      Affecting != AffectingEnd; ++Affecting) {
+    const ObjCInterfaceDecl *Class = Affecting->Method->getClassInterface();
+    StringRef AffectedKey = getAffectedKey(Affecting->Method, AffectedKeyBuffer);
+    if (AffectedKey.empty())
+      continue;
+    QualType Type = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(Class));
+    addManifestKeyPath(Writer, Type, Affecting->KeyPath, /*AllowPrivate=*/true, AffectedKey);
+  }
+
+  std::string Error = "no path given";
+  if (Options.ManifestPath.empty() || !Writer.write(Options.ManifestPath, Error)) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write key path manifest '%0': %1")) << Options.ManifestPath << Error;
+  }
+}
+
+
+// Each step records the accessor -valueForKey: finds at runtime, where
+// accessors private to the @implementation count too.
+void KeyPathValidationConsumer::addManifestKeyPath(KeyPathManifestWriter &Writer, QualType Type, StringRef KeyPath, bool AllowPrivate, StringRef AffectedKey) {
+  const ObjCObjectPointerType *Root = Type->getAsObjCInterfacePointerType();
+  if (!Root || isKVCContainer(Type))
+    return;
+  SmallVector<ResolvedKey, 4> Keys;
+  if (!resolveKeyPath(Type, KeyPath, AllowPrivate, Keys))
+    return;
+
+  SmallVector<KeyPathManifestWriter::Step, 4> Steps;
+  for (SmallVectorImpl<ResolvedKey>::const_iterator Key = Keys.begin(), KeyEnd = Keys.end(); Key != KeyEnd; ++Key) {
+    if (Key->Key == "self")
+      continue;
+    const ObjCObjectPointerType *Receiver = Key->Receiver->getAsObjCInterfacePointerType();
+    if (!Receiver || isKVCContainer(Key->Receiver))
+      continue;
+    const KVCAccessorTable *Table = getAccessorTable(Receiver->getInterfaceDecl());
+    const KVCAccessorTable::Entry *Accessor = Table ? Table->lookup(Key->Key, /*AllowPrivate=*/true) : NULL;
+    KeyPathManifestWriter::Step S;
+    S.Class = Receiver->getInterfaceDecl()->getName();
+    S.Key = Key->Key;
+    S.Kind = Accessor ? Accessor->Kind : KVCAccessorTable::AK_None;
+    Steps.push_back(S);
+  }
+  Writer.addKeyPath(Root->getInterfaceDecl()->getName(), KeyPath, AffectedKey, Steps);
+}
+
+
+void KeyPathValidationConsumer::reportBindingsCountMismatch(const ObjCArrayLiteral *Models, const ObjCArrayLiteral *KeyPaths) {
+  if (!Collected) {
+    Compiler.getDiagnostics().Report(Models->getLocStart(), BindingsCountMismatchDiagID)
+      << Models->getSourceRange() << KeyPaths->getSourceRange();
+    return;
+  }
+  KeyPathFinding F;
+  F.Kind = "bindings-count-mismatch";
+  F.Check = CurrentCheck ? CurrentCheck->getName() : "";
+  if (CurrentSend)
+    F.Selector = CurrentSend->getSelector().getAsString();
+  F.Message = "model and key path arrays must have same number of elements";
+  F.Loc = Models->getLocStart();
+  F.Range = SourceRange(Models->getLocStart(), KeyPaths->getLocEnd());
+  Collected->push_back(F);
+}
+
+
+void KeyPathValidationConsumer::reportKeyPathCost(QualType Type, const Expr *KeyPathExpr) {
+  if (!Options.PerfWarnings || Budget != BS_Within)
+    return;
+  const ObjCStringLiteral *KeyPathLiteral = dyn_cast<ObjCStringLiteral>(KeyPathExpr->IgnoreImplicit());
+  if (!KeyPathLiteral || CostReported.count(KeyPathLiteral))
+    return;
+
+  // An invalid key is reported as such (or held back, while streaming)
+  StringRef KeyPath = KeyPathLiteral->getString()->getString();
+  SmallVector<ResolvedKey, 4> Keys;
+  if (!resolveKeyPath(Type, KeyPath, /*AllowPrivate=*/false, Keys))
+    return;
+
+  // The last key being to-many only fetches the collection, and a
+  // collection operator (@count, @sum and so on) after it is computed by the
+  // collection itself
+  for (size_t I = 0; I + 1 < Keys.size(); ++I) {
+    if (Keys[I + 1].Key.startswith("@"))
+      break;
+    if (!isKVCCollectionType(Keys[I].Type))
+      continue;
+    CostReported.insert(KeyPathLiteral);
+    ++Stats.PerfWarnings;
+
+    StringRef Key = Keys[I].Key;
+    size_t KeyOffset = Key.data() - KeyPath.data();
+    SourceLocation KeyStart = KeyPathLiteral->getLocStart().getLocWithOffset(2 + KeyOffset); // @"
+    SourceRange KeyRange(KeyStart, KeyStart.getLocWithOffset(1));
+    if (!Collected)
+      Compiler.getDiagnostics().Report(KeyStart, ToManyKeyPathDiagID) << KeyPath << Key << KeyRange;
+
+    if (!Findings && !Collected)
+      return;
+    SmallString<64> Selector, TypeName, ContainerName;
+    SmallString<128> Message;
+    ("key path '" + KeyPath + "' goes through to-many key '" + Key + "'; the rest is evaluated for every element").toVector(Message);
+    FindingsWriter::Finding F;
+    F.Kind = "to-many-key-path";
+    F.Check = CurrentCheck ? CurrentCheck->getName() : "";
+    if (CurrentSend)
+      F.Selector = printSelector(CurrentSend->getSelector(), Selector);
+    F.KeyPath = KeyPath;
+    F.Key = Key;
+    F.KeyOffset = KeyOffset;
+    F.ReceiverType = printType(Keys[I].Receiver->getPointeeType(), Context.getPrintingPolicy(), TypeName);
+    F.Container = getContainerName(CurrentContainer, ContainerName);
+    F.Message = Message;
+    addFinding(F, KeyStart, KeyRange);
+    return;
+  }
+}
+
+
+void KeyPathValidationConsumer::reportSendInLoop(const ObjCMessageExpr *Send, const Expr *KeyPathExpr) {
+  if (!Options.PerfWarnings || Budget != BS_Within || !CurrentSendInLoop || CostReported.count(Send))
+    return;
+  CostReported.insert(Send);
+  ++Stats.PerfWarnings;
+
+  std::string Selector = Send->getSelector().getAsString();
+  std::string Replacement;
+  bool Fixable = KeyPathExpr && getPropertyAccess(Send, KeyPathExpr, Replacement);
+  if (!Collected) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(Send->getSelectorStartLoc(), SendInLoopDiagID) << Selector << Send->getSourceRange();
+    if (Fixable)
+      D.Report(Send->getLocStart(), PropertyAccessNoteID) << FixItHint::CreateReplacement(Send->getSourceRange(), Replacement);
+  }
+
+  if (!Findings && !Collected)
+    return;
+  const ObjCStringLiteral *KeyPathLiteral = KeyPathExpr ? dyn_cast<ObjCStringLiteral>(KeyPathExpr->IgnoreImplicit()) : NULL;
+  std::string Message = Selector + " looks up keys by name on every iteration of the loop";
+  FindingsWriter::Finding F;
+  F.Kind = "kvc-in-loop";
+  F.Check = CurrentCheck ? CurrentCheck->getName() : "";
+  F.Selector = Selector;
+  if (KeyPathLiteral)
+    F.KeyPath = KeyPathLiteral->getString()->getString();
+  std::string ReceiverType = Send->getReceiverType().getAsString();
+  F.ReceiverType = ReceiverType;
+  SmallString<64> ContainerName;
+  F.Container = getContainerName(CurrentContainer, ContainerName);
+  F.Message = Message;
+  addFinding(F, Send->getSelectorStartLoc(), Send->getSourceRange());
+  if (Collected && Fixable)
+    Collected->back().FixIt = FixItHint::CreateReplacement(Send->getSourceRange(), Replacement);
+}
+
+
+// [obj valueForKeyPath:@"a.b"] is obj.a.b when each key is a declared
+// property of object type, which is checked by the compiler and sent
+// directly. Anything else (ivars, collection accessors, containers, scalars
+// that KVC would box) is left alone.
+bool KeyPathValidationConsumer::getPropertyAccess(const ObjCMessageExpr *Send, const Expr *KeyPathExpr, std::string &Replacement) {
+  if (Send->getReceiverKind() != ObjCMessageExpr::Instance || Send->getNumArgs() != 1)
+    return false;
+  StringRef Name = Send->getSelector().getNameForSlot(0);
+  if (Name != "valueForKey" && Name != "valueForKeyPath")
+    return false;
+  const ObjCStringLiteral *KeyPathLiteral = dyn_cast<ObjCStringLiteral>(KeyPathExpr->IgnoreImplicit());
+  if (!KeyPathLiteral || Send->getLocStart().isMacroID() || Send->getLocEnd().isMacroID())
+    return false;
+  StringRef KeyPath = KeyPathLiteral->getString()->getString();
+  if (Name == "valueForKey" && KeyPath.find('.') != StringRef::npos)
+    return false;
+
+  const Expr *Receiver = Send->getInstanceReceiver()->IgnoreImplicit();
+  SmallVector<ResolvedKey, 4> Keys;
+  if (!resolveKeyPath(Receiver->getType(), KeyPath, /*AllowPrivate=*/false, Keys))
+    return false;
+  for (SmallVectorImpl<ResolvedKey>::const_iterator Key = Keys.begin(), KeyEnd = Keys.end(); Key != KeyEnd; ++Key) {
+    const ObjCObjectPointerType *KeyReceiver = Key->Receiver->getAsObjCInterfacePointerType();
+    if (!KeyReceiver || isKVCContainer(Key->Receiver))
+      return false;
+    const ObjCInterfaceDecl *Interface = KeyReceiver->getInterfaceDecl()->getDefinition();
+    const ObjCPropertyDecl *Property = Interface ? Interface->FindPropertyDeclaration(&Context.Idents.get(Key->Key)) : NULL;
+    if (!Property || !Property->getType()->isObjCObjectPointerType())
+      return false;
+  }
+
+  const SourceManager &SM = Context.getSourceManager();
+  StringRef ReceiverText = Lexer::getSourceText(CharSourceRange::getTokenRange(Receiver->getSourceRange()), SM, Context.getLangOpts());
+  if (ReceiverText.empty())
+    return false;
+  bool Postfix = isa<DeclRefExpr>(Receiver) || isa<ParenExpr>(Receiver) || isa<MemberExpr>(Receiver) ||
+                 isa<ObjCIvarRefExpr>(Receiver) || isa<ObjCMessageExpr>(Receiver) || isa<PseudoObjectExpr>(Receiver) ||
+                 isa<CallExpr>(Receiver) || isa<ArraySubscriptExpr>(Receiver);
+  Replacement = Postfix ? ReceiverText.str() : ("(" + ReceiverText + ")").str();
+  Replacement += '.';
+  Replacement += KeyPath;
+  return true;
+}
+
+
+void KeyPathValidationConsumer::addFinding(FindingsWriter::Finding &F, SourceLocation Loc, SourceRange Range) {
+  if (Collected) {
+    KeyPathFinding Owned;
+    Owned.Kind = F.Kind;
+    Owned.Check = F.Check;
+    Owned.Selector = F.Selector;
+    Owned.KeyPath = F.KeyPath;
+    Owned.Key = F.Key;
+    Owned.KeyOffset = F.KeyOffset;
+    Owned.ReceiverType = F.ReceiverType;
+    Owned.Message = F.Message;
+    Owned.Loc = Loc;
+    Owned.Range = Range;
+    Collected->push_back(Owned);
+  }
+  if (!Findings)
+    return;
+
+  const SourceManager &SM = Context.getSourceManager();
+  PresumedLoc Presumed = SM.getPresumedLoc(SM.getExpansionLoc(Loc));
+  if (Presumed.isValid()) {
+    F.File = Presumed.getFilename();
+    F.Line = Presumed.getLine();
+    F.Column = Presumed.getColumn();
+  }
+  Findings->add(F);
+}
+
+
+// As __PRETTY_FUNCTION__ would name a method, or the function, class,
+// protocol or category
+StringRef KeyPathValidationConsumer::getContainerName(const Decl *Container, SmallVectorImpl<char> &Buffer) {
+  Buffer.clear();
+  llvm::raw_svector_ostream OS(Buffer);
+  if (const ObjCMethodDecl *Method = dyn_cast_or_null<ObjCMethodDecl>(Container)) {
+    OS << (Method->isInstanceMethod() ? "-[" : "+[");
+    printContainerName(OS, dyn_cast<ObjCContainerDecl>(Method->getDeclContext()));
+    OS << ' ';
+    printSelector(OS, Method->getSelector());
+    OS << ']';
+  } else if (const FunctionDecl *Function = dyn_cast_or_null<FunctionDecl>(Container)) {
+    Function->printQualifiedName(OS);
+  } else {
+    printContainerName(OS, dyn_cast_or_null<ObjCContainerDecl>(Container));
+  }
+  return OS.str();
+}
+
+
+void KeyPathValidationConsumer::addPendingKeyPath(QualType Type, SourceRange ModelRange, StringRef KeyPath, SourceRange KeyRange, bool AllowPrivate, bool SingleKey, StringRef SiteKey) {
+  PendingKeyPaths.push_back(PendingKeyPath());
+  PendingKeyPath &Site = PendingKeyPaths.back();
+  Site.Type = Type;
+  Site.KeyPath = Site.Remaining = KeyPath;
+  Site.ModelRange = ModelRange;
+  Site.KeyRange = KeyRange;
+  Site.Offset = 2; // @"
+  Site.AllowPrivate = AllowPrivate;
+  Site.SingleKey = SingleKey;
+  Site.Done = false;
+  Site.Valid = true;
+  Site.FromResultCache = false;
+  Site.KeyLookups = 0;
+  Site.SiteKey = copyToArena(SiteArena, SiteKey);
+  Site.Check = CurrentCheck;
+  Site.Send = CurrentSend;
+  Site.Container = CurrentContainer;
+}
+
+
+namespace {
+struct PendingKeyPathsJob {
+  KeyPathValidationConsumer *Consumer;
+  const std::vector<unsigned> *Active;
+};
+
+// Sites are handed out in batches, as each takes about as long as a lock
+const unsigned SitesPerJob = 32;
+
+struct KeyLocationBefore {
+  BeforeThanCompare<SourceLocation> IsBefore;
+
+  explicit KeyLocationBefore(SourceManager &SM) : IsBefore(SM) { }
+  bool operator()(const std::pair<SourceLocation, unsigned> &A, const std::pair<SourceLocation, unsigned> &B) const {
+    return IsBefore(A.first, B.first);
+  }
+};
+}
+
+
+// Phase two of parallel validation. Resolving a key needs the receiver's
+// accessor tables, which are built on this thread, so resolution goes in
+// waves: the types every unfinished site is at are frozen into an index, the
+// sites are resolved on the pool as far as the index allows, and so on. Each
+// wave advances each site by at least one key. Diagnostics are then emitted
+// here, in source order.
+void KeyPathValidationConsumer::resolvePendingKeyPaths() {
+  if (PendingKeyPaths.empty())
+    return;
+  StatsTimer::Region Timing(KeyLookupTimer.get());
+  IdType = Context.getObjCIdType();
+
+  std::vector<unsigned> Active;
+  for (unsigned Index = 0, End = PendingKeyPaths.size(); Index != End; ++Index) {
+    PendingKeyPath &Site = PendingKeyPaths[Index];
+    ResultCache::Result Result;
+    if (!Site.SiteKey.empty()) {
+      if (Results->lookup(Site.SiteKey, Result) && areDependenciesCurrent(Result.Dependencies) &&
+          (Result.Valid || Result.KeyOffset >= 2) && Result.KeyOffset + Result.KeyLength <= Site.KeyPath.size() + 2) {
+        ++Stats.ResultCacheHits;
+        Site.Done = Site.FromResultCache = true;
+        Site.Valid = Result.Valid;
+        if (!Result.Valid) {
+          Site.Offset = Result.KeyOffset;
+          Site.InvalidKey = Site.KeyPath.substr(Result.KeyOffset - 2, Result.KeyLength);
+          Site.TypeName = copyToArena(SiteArena, Result.TypeName);
+        }
+        continue;
+      }
+      ++Stats.ResultCacheMisses;
+    }
+    Active.push_back(Index);
+  }
+
+  while (!Active.empty()) {
+    ++Stats.ResolutionWaves;
+    for (std::vector<unsigned>::const_iterator I = Active.begin(), E = Active.end(); I != E; ++I)
+      freezeReceiver(PendingKeyPaths[*I].Type);
+
+    PendingKeyPathsJob Job = { this, &Active };
+    WorkStealingPool::run((Active.size() + SitesPerJob - 1) / SitesPerJob, Options.ResolverThreads, &resolvePendingKeyPathsJob, &Job);
+
+    std::vector<unsigned> StillActive;
+    for (std::vector<unsigned>::const_iterator I = Active.begin(), E = Active.end(); I != E; ++I)
+      if (!PendingKeyPaths[*I].Done)
+        StillActive.push_back(*I);
+    Active.swap(StillActive);
+  }
+
+  std::vector<std::pair<SourceLocation, unsigned> > Invalid;
+  SmallString<64> TypeName;
+  for (std::vector<PendingKeyPath>::iterator Site = PendingKeyPaths.begin(), SiteEnd = PendingKeyPaths.end(); Site != SiteEnd; ++Site) {
+    Stats.KeyLookups += Site->KeyLookups;
+    if (!Site->Valid) {
+      if (!Site->FromResultCache)
+        Site->TypeName = copyToArena(SiteArena, printType(Site->Type->getPointeeType(), Context.getPrintingPolicy(), TypeName));
+      Invalid.push_back(std::make_pair(Site->KeyRange.getBegin().getLocWithOffset(Site->Offset), unsigned(Site - PendingKeyPaths.begin())));
+    }
+    if (Site->SiteKey.empty() || Site->FromResultCache)
+      continue;
+
+    ResultCache::Result Result;
+    for (SmallVectorImpl<QualType>::const_iterator Receiver = Site->Receivers.begin(), ReceiverEnd = Site->Receivers.end();
+        Receiver != ReceiverEnd; ++Receiver)
+      addDependencies(*Receiver, Result.Dependencies);
+    if (!Site->Valid) {
+      Result.Valid = false;
+      Result.KeyOffset = Site->Offset;
+      Result.KeyLength = Site->InvalidKey.size();
+      Result.TypeName = Site->TypeName;
+    }
+    Results->store(Site->SiteKey, Result);
+  }
+
+  std::stable_sort(Invalid.begin(), Invalid.end(), KeyLocationBefore(Context.getSourceManager()));
+  for (std::vector<std::pair<SourceLocation, unsigned> >::const_iterator I = Invalid.begin(), E = Invalid.end(); I != E; ++I) {
+    const PendingKeyPath &Site = PendingKeyPaths[I->second];
+    QualType Receiver = Site.FromResultCache ? resolveKeyReceiver(Site.Type, Site.KeyPath, Site.InvalidKey, Site.AllowPrivate) : Site.Type;
+    reportInvalidKey(Site.KeyPath, Site.InvalidKey, Site.TypeName, Receiver, Site.AllowPrivate, Site.ModelRange, Site.KeyRange, Site.Offset, Site.Check, Site.Send, Site.Container);
+  }
+
+  Stats.KeyPathsResolvedInParallel += PendingKeyPaths.size();
+  PendingKeyPaths.clear();
+  SiteArena.Reset();
+}
+
+
+StringRef KeyPathValidationConsumer::copyToArena(llvm::BumpPtrAllocator &Arena, StringRef S) {
+  if (S.empty())
+    return StringRef();
+  char *Copy = static_cast<char *>(Arena.Allocate(S.size(), 1));
+  std::copy(S.begin(), S.end(), Copy);
+  return StringRef(Copy, S.size());
+}
+
+
+void KeyPathValidationConsumer::resolvePendingKeyPathsJob(void *Context, unsigned Index) {
+  const PendingKeyPathsJob *Job = static_cast<const PendingKeyPathsJob *>(Context);
+  const std::vector<unsigned> &Active = *Job->Active;
+  KeyPathValidationConsumer *Consumer = Job->Consumer;
+  for (size_t I = Index * SitesPerJob, E = std::min<size_t>(I + SitesPerJob, Active.size()); I != E; ++I)
+    Consumer->resolveFrozen(Consumer->PendingKeyPaths[Active[I]]);
+}
+
+
+// What resolveKeyType would find, computed here so resolveFrozen doesn't
+// have to: the accessor tables, and whether the type is a KVC container.
+void KeyPathValidationConsumer::freezeReceiver(QualType Type) {
+  void *Key = Type.getCanonicalType().getAsOpaquePtr();
+  if (FrozenReceivers.count(Key))
+    return;
+
+  FrozenReceiver Receiver;
+  Receiver.Container = isKVCContainer(Type);
+  Receiver.Table = NULL;
+  if (const ObjCObjectPointerType *ObjType = Type->getAs<ObjCObjectPointerType>()) {
+    if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl())
+      Receiver.Table = getAccessorTable(Interface);
+    for (ObjCObjectPointerType::qual_iterator Proto = ObjType->qual_begin(), ProtoEnd = ObjType->qual_end();
+        Proto != ProtoEnd; ++Proto)
+      if (const KVCAccessorTable *Table = getAccessorTable(*Proto))
+        Receiver.ProtocolTables.push_back(Table);
+  }
+  FrozenReceivers[Key] = Receiver;
+}
+
+
+// Runs on resolver threads, so only reads the frozen index, the tables in it
+// and the types they hold. Mirrors CheckKeyType and resolveKeyType; stops at
+// a receiver that isn't in the index.
+void KeyPathValidationConsumer::resolveFrozen(PendingKeyPath &Site) const {
+  while (!Site.Done) {
+    llvm::DenseMap<void *, FrozenReceiver>::const_iterator Frozen = FrozenReceivers.find(Site.Type.getCanonicalType().getAsOpaquePtr());
+    if (Frozen == FrozenReceivers.end())
+      return;
+
+    StringRef Key;
+    if (Site.SingleKey)
+      Key = Site.Remaining, Site.Remaining = StringRef();
+    else
+      llvm::tie(Key, Site.Remaining) = Site.Remaining.split('.');
+    if (Key.empty() && !Site.SingleKey) {
+      Site.Done = true;
+      return;
+    }
+    if (!Site.SiteKey.empty())
+      Site.Receivers.push_back(Site.Type);
+    ++Site.KeyLookups;
+
+    if (Key.equals("self") || Frozen->second.Container) {
+      if (!Key.equals("self"))
+        Site.Type = IdType;
+    } else {
+      const KVCAccessorTable::Entry *Accessor = NULL;
+      if (Frozen->second.Table)
+        Accessor = Frozen->second.Table->lookup(Key, Site.AllowPrivate);
+      for (SmallVectorImpl<const KVCAccessorTable *>::const_iterator Table = Frozen->second.ProtocolTables.begin(), TableEnd = Frozen->second.ProtocolTables.end();
+          !Accessor && Table != TableEnd; ++Table)
+        Accessor = (*Table)->lookup(Key, false);
+
+      if (!Accessor || Accessor->Type.isNull()) {
+        Site.Done = true;
+        Site.Valid = false;
+        Site.InvalidKey = Key;
+        return;
+      }
+      if (Accessor->Type->isObjCObjectPointerType())
+        Site.Type = Accessor->Type;
+      else if (isNumberType(Accessor->Type))
+        Site.Type = NSNumberPtrType;
+    }
+
+    Site.Offset += Key.size() + 1;
+    if (Site.SingleKey)
+      Site.Done = true;
+  }
+}
+
+
+// A site is its position in the file, what's looked up there, and the options
+// affecting the lookup. The classes involved are checked separately, through
+// the dependencies stored with the result.
+void KeyPathValidationConsumer::makeSiteKey(SmallVectorImpl<char> &Buffer, QualType Type, const Expr *ModelExpr, const Expr *KeyPathExpr, StringRef KeyPath, bool AllowPrivate) {
+  const SourceManager &SM = Context.getSourceManager();
+  PresumedLoc Site = SM.getPresumedLoc(SM.getExpansionLoc(KeyPathExpr->getLocStart()));
+
+  Buffer.clear();
+  llvm::raw_svector_ostream OS(Buffer);
+  if (Site.isValid())
+    OS << Site.getFilename() << ':' << Site.getLine() << ':' << Site.getColumn();
+  OS << '\0';
+  Type.getCanonicalType().print(OS, Context.getPrintingPolicy());
+  OS << '\0' << (AllowPrivate ? 'P' : '-') << (ModelExpr ? 'M' : '-')
+     << '\0' << KeyPath;
+  OS.flush();
+}
+
+
+void KeyPathValidationConsumer::addDependencies(QualType Type, std::vector<ResultCache::Dependency> &Dependencies) {
+  const ObjCObjectPointerType *ObjType = Type->getAs<ObjCObjectPointerType>();
+  if (!ObjType)
+    return;
+
+  SmallVector<const ObjCContainerDecl *, 4> Containers;
+  if (const ObjCInterfaceDecl *Interface = ObjType->getInterfaceDecl())
+    Containers.push_back(Interface);
+  Containers.append(ObjType->qual_begin(), ObjType->qual_end());
+
+  for (SmallVectorImpl<const ObjCContainerDecl *>::const_iterator Container = Containers.begin(), ContainerEnd = Containers.end();
+      Container != ContainerEnd; ++Container) {
+    ResultCache::Dependency D;
+    D.Name = (*Container)->getName();
+    D.IsProtocol = isa<ObjCProtocolDecl>(*Container);
+    D.Fingerprint = getFingerprint(*Container);
+
+    bool Seen = false;
+    for (std::vector<ResultCache::Dependency>::const_iterator Other = Dependencies.begin(), OtherEnd = Dependencies.end();
+        !Seen && Other != OtherEnd; ++Other)
+      Seen = Other->Name == D.Name && Other->IsProtocol == D.IsProtocol;
+    if (!Seen)
+      Dependencies.push_back(D);
+  }
+}
+
+
+bool KeyPathValidationConsumer::areDependenciesCurrent(const std::vector<ResultCache::Dependency> &Dependencies) {
+  for (std::vector<ResultCache::Dependency>::const_iterator D = Dependencies.begin(), DEnd = Dependencies.end(); D != DEnd; ++D) {
+    NamedDecl *Container = lookupTopLevel(D->Name, D->IsProtocol ? Decl::ObjCProtocol : Decl::ObjCInterface);
+    if (!Container || getFingerprint(cast<ObjCContainerDecl>(Container)) != D->Fingerprint)
+      return false;
+  }
+  return true;
+}
+
+
+// Covers every file contributing to the container's accessor table (see
+// getAccessorTable), by name, size and modification time.
+StringRef KeyPathValidationConsumer::getFingerprint(const ObjCContainerDecl *Container) {
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container))
+    Container = Interface->getDefinition();
+  else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(Container))
+    Container = Protocol->getDefinition();
+  if (!Container)
+    return StringRef();
+
+  llvm::DenseMap<const ObjCContainerDecl *, StringRef>::const_iterator Cached = Fingerprints.find(Container);
+  if (Cached != Fingerprints.end())
+    return Cached->second;
+  // Registered before it's computed, so invalid cyclic code terminates
+  Fingerprints[Container] = StringRef();
+
+  llvm::MD5 Hash;
+  addFileStamp(Hash, Container->getLocation());
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container)) {
+    for (ObjCInterfaceDecl::visible_categories_iterator Category = Interface->visible_categories_begin(), CategoryEnd = Interface->visible_categories_end();
+        Category != CategoryEnd; ++Category) {
+      addFileStamp(Hash, Category->getLocation());
+      if (const ObjCCategoryImplDecl *CategoryImpl = Category->getImplementation())
+        addFileStamp(Hash, CategoryImpl->getLocation());
+      for (ObjCCategoryDecl::protocol_iterator Proto = Category->protocol_begin(), ProtoEnd = Category->protocol_end();
+          Proto != ProtoEnd; ++Proto)
+        Hash.update(getFingerprint(*Proto));
+    }
+    if (const ObjCImplementationDecl *Impl = Interface->getImplementation())
+      addFileStamp(Hash, Impl->getLocation());
+    for (ObjCInterfaceDecl::all_protocol_iterator Proto = Interface->all_referenced_protocol_begin(), ProtoEnd = Interface->all_referenced_protocol_end();
+        Proto != ProtoEnd; ++Proto)
+      Hash.update(getFingerprint(*Proto));
+    if (const ObjCInterfaceDecl *Super = Interface->getSuperClass())
+      Hash.update(getFingerprint(Super));
+
+  } else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(Container)) {
+    for (ObjCProtocolDecl::protocol_iterator Proto = Protocol->protocol_begin(), ProtoEnd = Protocol->protocol_end();
+        Proto != ProtoEnd; ++Proto)
+      Hash.update(getFingerprint(*Proto));
+  }
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+  // Kept with the lookup caches, which are invalidated along with it
+  StringRef Fingerprint = copyToArena(LookupArena, Digest);
+  Fingerprints[Container] = Fingerprint;
+  return Fingerprint;
+}
+
+
+// Tells a summary written for an earlier build of the PCH from a current
+// one. Only file names are hashed, not whole paths, as the PCH build and the
+// TUs including it may spell them differently.
+void KeyPathValidationConsumer::getSummaryStamp(const ObjCContainerDecl *Container, SmallVectorImpl<char> &Out) {
+  llvm::MD5 Hash;
+  addFileStamp(Hash, Container->getLocation(), /*NameOnly=*/true);
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container))
+    for (ObjCInterfaceDecl::visible_categories_iterator Category = Interface->visible_categories_begin(), CategoryEnd = Interface->visible_categories_end();
+        Category != CategoryEnd; ++Category)
+      addFileStamp(Hash, Category->getLocation(), /*NameOnly=*/true);
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+  Out.assign(Digest.begin(), Digest.end());
+}
+
+
+void KeyPathValidationConsumer::addFileStamp(llvm::MD5 &Hash, SourceLocation Loc, bool NameOnly) {
+  const SourceManager &SM = Context.getSourceManager();
+  const FileEntry *File = SM.getFileEntryForID(SM.getFileID(SM.getExpansionLoc(Loc)));
+  if (!File) {
+    Hash.update("<no file>");
+    return;
+  }
+
+  Hash.update(NameOnly ? llvm::sys::path::filename(File->getName()) : StringRef(File->getName()));
+  time_t ModTime = File->getModificationTime();
+  off_t Size = File->getSize();
+  Hash.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&ModTime), sizeof(ModTime)));
+  Hash.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&Size), sizeof(Size)));
 }
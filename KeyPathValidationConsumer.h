@@ -12,28 +12,89 @@
 #include "clang/Frontend/FrontendPluginRegistry.h"
 #include "clang/AST/AST.h"
 #include "clang/AST/ASTConsumer.h"
-#include "clang/AST/NSAPI.h"
 #include "clang/AST/Attr.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/TimeValue.h"
+#include "CheckDispatchVisitor.h"
+#include "FindingsWriter.h"
+#include "KeyPathValidationCheck.h"
+#include "KeyPathValidationOptions.h"
+#include "KeyPathValidationStats.h"
+#include "KVCAccessorTable.h"
+#include "KVCSummary.h"
+#include "KeyPathManifest.h"
+#include "NearestKeyIndex.h"
+#include "ResultCache.h"
+#include "SelectorRegistry.h"
+#include "TraversalFilter.h"
 
 using namespace clang;
 
+
+// What validateDecl and validateRange return, for hosts that present results
+// themselves rather than through clang's diagnostics.
+struct KeyPathFinding {
+  KeyPathFinding() : KeyOffset(0) { }
+
+  // As in FindingsWriter::Finding, or "bindings-count-mismatch"
+  std::string Kind, Check, Selector, KeyPath, Key, ReceiverType, Message;
+  size_t KeyOffset;
+  SourceLocation Loc;
+  SourceRange Range;
+  // Empty unless there's a fix-it
+  FixItHint FixIt;
+};
+
+
 class KeyPathValidationConsumer : public ASTConsumer {
 public:
-  KeyPathValidationConsumer(const CompilerInstance &Compiler)
+  KeyPathValidationConsumer(const CompilerInstance &Compiler, const KeyPathValidationOptions &Options)
     : ASTConsumer()
     , Compiler(Compiler)
     , Context(Compiler.getASTContext())
+    , Options(Options)
+    , Selectors(Context)
+    , ArenaSlabs(Stats)
+    , LookupArena(4096, 4096, ArenaSlabs), SiteArena(4096, 4096, ArenaSlabs)
+    , KeyCache(LookupArena), PrefixCache(LookupArena)
+    , NSDictionaryInterface(NULL), NSArrayInterface(NULL), NSSetInterface(NULL), NSOrderedSetInterface(NULL)
+    , ValidationStarted(false), LookupCachesStale(false), DeferInvalidKeys(false), InvalidKeyDeferred(false)
+    , InvalidKeyDeferredOverBudget(false)
+    , CurrentCheck(NULL), CurrentSend(NULL), CurrentContainer(NULL), CurrentSendInLoop(false), Collected(NULL)
+    , Budget(BS_Within), ReplayBudget(BS_Within), Replaying(false)
   {
-    NSAPIObj.reset(new NSAPI(Context));
+    Selectors.addBuiltins();
+    if (!Options.ResultCacheDir.empty())
+      Results.reset(new ResultCache(Options.ResultCacheDir));
 	DiagnosticsEngine::Level L = DiagnosticsEngine::Warning;
 	if (Compiler.getDiagnostics().getWarningsAsErrors())
 	  L = DiagnosticsEngine::Error;
     KeyDiagID = Compiler.getDiagnostics().getCustomDiagID(L, "key '%0' not found on type %1");
+    KeySuggestionDiagID = Compiler.getDiagnostics().getCustomDiagID(L, "key '%0' not found on type %1; did you mean '%2'?");
+    BindingsCountMismatchDiagID = Compiler.getDiagnostics().getCustomDiagID(DiagnosticsEngine::Error, "model and key path arrays must have same number of elements");
+    ToManyKeyPathDiagID = Compiler.getDiagnostics().getCustomDiagID(L, "key path '%0' goes through to-many key '%1'; the rest is evaluated for every element");
+    SendInLoopDiagID = Compiler.getDiagnostics().getCustomDiagID(L, "%0 looks up keys by name on every iteration of the loop");
+    PropertyAccessNoteID = Compiler.getDiagnostics().getCustomDiagID(DiagnosticsEngine::Note, "access the property directly");
   }
 
+  // The consumer the plug-in uses, with the selectors named in Options and
+  // every check registered.
+  static KeyPathValidationConsumer *create(const CompilerInstance &Compiler, const KeyPathValidationOptions &Options);
+
+  virtual ~KeyPathValidationConsumer();
+
+  virtual bool HandleTopLevelDecl(DeclGroupRef DG);
   virtual void HandleTranslationUnit(ASTContext &Context);
 
+  // Takes ownership; every check is driven from a single traversal.
+  void addCheck(KeyPathValidationCheck *Check) { Checks.push_back(Check); }
+
   bool CheckKeyType(QualType &ObjTypeInOut, StringRef &Key, bool AllowPrivate);
 
   void emitDiagnosticsForReceiverAndKeyPath(const Expr *ModelExpr, const Expr *KeyPathExpr, bool AllowPrivate=false) {
@@ -42,32 +103,294 @@ public:
 
   void emitDiagnosticsForTypeAndKey(QualType Type, const Expr *KeyExpr, bool AllowPrivate=false) {
     const ObjCStringLiteral *KeyPathLiteral = dyn_cast<ObjCStringLiteral>(KeyExpr);
-    if (KeyPathLiteral)
-      emitDiagnosticsForTypeAndMaybeReceiverAndKey(Type, SourceRange(), KeyPathLiteral->getString()->getString(), KeyExpr->getSourceRange(), 0, AllowPrivate);
+    if (KeyPathLiteral) {
+      BudgetState State = chargeBudget(KeyExpr);
+      if (State == BS_Stopped)
+        return;
+      if (!Replaying)
+        ++Stats.KeyPathsValidated;
+      StringRef Key = KeyPathLiteral->getString()->getString();
+      if (Options.WriteManifest && State == BS_Within && !Replaying)
+        noteManifestKeyPath(Type, Key, AllowPrivate, /*SingleKey=*/true);
+      if (Options.ResolverThreads > 1) {
+        addPendingKeyPath(Type, SourceRange(), Key, KeyExpr->getSourceRange(), AllowPrivate, /*SingleKey=*/true);
+        return;
+      }
+      emitDiagnosticsForTypeAndMaybeReceiverAndKey(Type, SourceRange(), Key, Key, KeyExpr->getSourceRange(), 2, AllowPrivate); // @"
+    }
   }
 
   void emitDiagnosticsForTypeAndKeyPath(QualType Type, const Expr *KeyPathExpr, bool AllowPrivate=false) {
     emitDiagnosticsForTypeAndMaybeReceiverAndKeyPath(Type, NULL, KeyPathExpr, AllowPrivate);
   }
 
-  unsigned KeyDiagID;
+  unsigned KeyDiagID, KeySuggestionDiagID, BindingsCountMismatchDiagID;
+  unsigned ToManyKeyPathDiagID, SendInLoopDiagID, PropertyAccessNoteID;
+
+  SelectorRegistry &getSelectorRegistry() { return Selectors; }
+
+  // Checks report each message send they act on
+  void noteMatchedMessageSend() { ++Stats.MessageSendsMatched; }
+  const KeyPathValidationStats &getStats() const { return Stats; }
+
+  // The dispatcher brackets each check it runs, so findings can say where
+  // they came from. While streaming, a key that isn't found may yet be
+  // declared later in the TU, so it isn't reported; endCheckVisit() says
+  // whether that happened, in which case the check is run again at the end.
+  // Container is the function, method or class the visit is in, and InLoop
+  // whether Send runs on every iteration of a loop.
+  void beginCheckVisit(const KeyPathValidationCheck *Check, const ObjCMessageExpr *Send, const Decl *Container, bool InLoop) {
+    CurrentCheck = Check;
+    CurrentSend = Send;
+    CurrentContainer = Container;
+    CurrentSendInLoop = InLoop;
+    InvalidKeyDeferred = false;
+    InvalidKeyDeferredOverBudget = false;
+  }
+  bool endCheckVisit() {
+    CurrentCheck = NULL;
+    CurrentSend = NULL;
+    CurrentContainer = NULL;
+    return InvalidKeyDeferred;
+  }
+  // Whether the key held back was checked after the budget ran out
+  bool invalidKeyDeferredOverBudget() const { return InvalidKeyDeferredOverBudget; }
+
+  // Visits run again at the end were charged to the budget, counted and
+  // noted for the manifest the first time, and are checked as fully as
+  // they were then: only the first key if OverBudget.
+  void beginReplayedVisit(bool OverBudget) {
+    Replaying = true;
+    ReplayBudget = OverBudget ? BS_Degraded : BS_Within;
+  }
+  void endReplay() { Replaying = false; }
+
+  // With perf, warns about valid key paths that are slow at runtime: those
+  // going through a to-many relationship, where KVC evaluates the rest of
+  // the path for every element, and sends in loops, which look keys up by
+  // name on every iteration. KeyPathExpr is NULL for sends without a single
+  // key path; a -valueForKey: or -valueForKeyPath: of declared properties
+  // also gets a fix-it to property access.
+  void reportKeyPathCost(QualType Type, const Expr *KeyPathExpr);
+  void reportSendInLoop(const ObjCMessageExpr *Send, const Expr *KeyPathExpr);
+
+  // With budget-mode=stop, whether the budget has run out
+  bool isOutOfBudget() const { return Budget == BS_Stopped && !Collected; }
+
+  // Records a key path returned from +keyPathsForValuesAffecting<Key> in the
+  // findings file and the KVO graph, if they're being written.
+  void noteAffectingKeyPath(const ObjCMethodDecl *Method, const ObjCStringLiteral *KeyPath);
+  void reportBindingsCountMismatch(const ObjCArrayLiteral *Models, const ObjCArrayLiteral *KeyPaths);
+
+  // Each key of a key path, with the type it was looked up on and the type
+  // it resolved to.
+  struct ResolvedKey {
+    StringRef Key;
+    QualType Receiver, Type;
+  };
+  // Resolves KeyPath from Type without reporting anything, stopping at the
+  // first key that isn't found; true if every key was.
+  bool resolveKeyPath(QualType Type, StringRef KeyPath, bool AllowPrivate, SmallVectorImpl<ResolvedKey> &Keys);
+
+  // For hosts that keep the AST loaded, such as an editor: runs every check
+  // on D alone, or on each function and method overlapping Range, and
+  // appends what they find to Out instead of reporting it. Accessor tables
+  // and key resolutions stay cached from one call to the next, so
+  // re-checking an edited method costs about as much as the method.
+  void validateDecl(Decl *D, std::vector<KeyPathFinding> &Out);
+  void validateRange(SourceRange Range, std::vector<KeyPathFinding> &Out);
 
 private:
   const CompilerInstance &Compiler;
   ASTContext &Context;
-  OwningPtr<NSAPI> NSAPIObj;
+  const KeyPathValidationOptions Options;
+  SelectorRegistry Selectors;
+  SmallVector<KeyPathValidationCheck *, 4> Checks;
+
+  KeyPathValidationStats Stats;
+  // Lookup cache entries, dropped with the caches; and what pending key
+  // paths need copied, dropped once they're resolved. Neither touches the
+  // heap again once it has grown to fit.
+  CountingSlabAllocator ArenaSlabs;
+  llvm::BumpPtrAllocator LookupArena, SiteArena;
+  // Only set up when times are wanted (stats, or clang's -ftime-report).
+  // The group outlives the timers, so it reports once they're all done.
+  OwningPtr<llvm::TimerGroup> TimeReportGroup;
+  OwningArrayPtr<StatsTimer> CheckTimers;
+  OwningPtr<StatsTimer> KeyLookupTimer;
 
   QualType NSNumberPtrType;
 
+  // Resolutions are keyed on (canonical receiver type, AllowPrivate, key).
+  // Prefixes of key paths that resolved are cached the same way, mapping to
+  // the type reached at the end of the prefix.
+  struct KeyResolution {
+    QualType Type;
+    bool Valid;
+  };
+  llvm::StringMap<KeyResolution, llvm::BumpPtrAllocator &> KeyCache;
+  llvm::StringMap<QualType, llvm::BumpPtrAllocator &> PrefixCache;
+
   // Hard-coded set of KVC containers (can't add attributes in a category)
   ObjCInterfaceDecl *NSDictionaryInterface, *NSArrayInterface, *NSSetInterface, *NSOrderedSetInterface;
 
+  // What each class is, for KVC purposes; see getInterfaceClass
+  enum InterfaceClassFlags {
+    IC_Container = 1 << 0,  // answers any key (Foundation collection, or annotated)
+    IC_Collection = 1 << 1, // to-many: NSArray, NSOrderedSet or NSSet
+    IC_Ordered = 1 << 2,    // NSArray or NSOrderedSet
+    IC_Annotated = 1 << 3   // objc_kvc_container, on the class or a superclass
+  };
+  llvm::DenseMap<const ObjCInterfaceDecl *, unsigned> InterfaceClasses;
+
+  llvm::DenseMap<const ObjCContainerDecl *, KVCAccessorTable *> AccessorTables;
+  // Built on the first invalid key looked up in a table
+  llvm::DenseMap<const KVCAccessorTable *, NearestKeyIndex *> KeyIndexes;
+
+  // Tables for classes from the precompiled header, if it came with a summary.
+  // Types are resolved on first use, indexed as in the summary.
+  llvm::IntrusiveRefCntPtr<KVCSummary> Summary;
+  std::vector<QualType> SummaryTypes;
+
+  // Whole key path results from earlier compiles, and fingerprints of the
+  // declarations of each class and protocol they depend on
+  OwningPtr<ResultCache> Results;
+  llvm::DenseMap<const ObjCContainerDecl *, StringRef> Fingerprints; // in LookupArena
+
+  // Set up by the first decl streamed, or at the end of the TU
+  bool ValidationStarted;
+  OwningPtr<TraversalFilter> Filter;
+  OwningPtr<CheckDispatchVisitor> Dispatcher;
+
+  // Streaming state: top-level decls already validated, whether containers
+  // have been defined since the caches were filled, and whether an invalid
+  // key is currently being held back
+  llvm::SmallPtrSet<const Decl *, 64> StreamedDecls;
+  bool LookupCachesStale;
+  bool DeferInvalidKeys, InvalidKeyDeferred, InvalidKeyDeferredOverBudget;
+
+  // The check being run, on which message send and in what, for findings
+  const KeyPathValidationCheck *CurrentCheck;
+  const ObjCMessageExpr *CurrentSend;
+  const Decl *CurrentContainer;
+  bool CurrentSendInLoop;
+  // Key paths and sends already warned about with perf, as a visit may be
+  // run again after streaming
+  llvm::SmallPtrSet<const Expr *, 16> CostReported;
+  OwningPtr<FindingsWriter> Findings;
+  // Set during validateDecl and validateRange
+  std::vector<KeyPathFinding> *Collected;
+
+  // Key paths returned by +keyPathsForValuesAffecting<Key>, resolved for the
+  // KVO graph and the manifest once the whole TU has been seen
+  struct AffectingKeyPath {
+    const ObjCMethodDecl *Method;
+    StringRef KeyPath;
+  };
+  std::vector<AffectingKeyPath> AffectingKeyPaths;
+
+  // Every other literal key path, for the manifest, likewise resolved at the end
+  struct ManifestKeyPath {
+    QualType Type;
+    StringRef KeyPath;
+    bool AllowPrivate;
+  };
+  std::vector<ManifestKeyPath> ManifestKeyPaths;
+
+  // Whether the budget in Options has run out, and the time spent against
+  // it. The clock only runs while validating, not while streaming parses.
+  // While replaying deferred visits, ReplayBudget is how far the visit
+  // being replayed was checked the first time.
+  enum BudgetState { BS_Within, BS_Degraded, BS_Stopped };
+  BudgetState Budget, ReplayBudget;
+  bool Replaying;
+  llvm::sys::TimeValue BudgetTimeSpent, BudgetClockStart;
+
+  // With more than one resolver thread, key paths are collected during the
+  // traversal and resolved together at the end (see resolvePendingKeyPaths).
+  struct PendingKeyPath {
+    QualType Type;            // receiver of the next key
+    StringRef KeyPath, Remaining;
+    SourceRange ModelRange, KeyRange;
+    size_t Offset;            // of the next key (or the invalid one) in KeyRange
+    bool AllowPrivate, SingleKey;
+    bool Done, Valid, FromResultCache;
+    unsigned KeyLookups;
+    StringRef InvalidKey;
+    StringRef TypeName;       // these two in SiteArena
+    StringRef SiteKey;        // for the result cache, if in use
+    SmallVector<QualType, 4> Receivers;
+    const KeyPathValidationCheck *Check;
+    const ObjCMessageExpr *Send;
+    const Decl *Container;
+  };
+  std::vector<PendingKeyPath> PendingKeyPaths;
+
+  // Everything a resolver thread needs to know about a receiver type, so it
+  // never touches the AST or ASTContext itself. Keyed on the canonical type.
+  struct FrozenReceiver {
+    bool Container;
+    const KVCAccessorTable *Table;
+    SmallVector<const KVCAccessorTable *, 2> ProtocolTables;
+  };
+  llvm::DenseMap<void *, FrozenReceiver> FrozenReceivers;
+  QualType IdType;
+
+  void addPendingKeyPath(QualType Type, SourceRange ModelRange, StringRef KeyPath, SourceRange KeyRange, bool AllowPrivate, bool SingleKey, StringRef SiteKey = StringRef());
+  void resolvePendingKeyPaths();
+  static StringRef copyToArena(llvm::BumpPtrAllocator &Arena, StringRef S);
+  void freezeReceiver(QualType Type);
+  void resolveFrozen(PendingKeyPath &Site) const;
+  static void resolvePendingKeyPathsJob(void *Context, unsigned Index);
+
+  void beginValidation();
+  void startBudgetClock();
+  void stopBudgetClock();
+  BudgetState chargeBudget(const Expr *KeyPathExpr);
+  bool mayNeedValidation();
+  void openFindings();
+  void finishOutputs();
+  void validateDecls(ArrayRef<Decl *> Decls, std::vector<KeyPathFinding> &Out);
+  void noteTopLevelContainer(const ObjCContainerDecl *Container);
+  void invalidateLookupCaches();
   void cacheNSTypes();
+  void startTiming();
+  void reportStats();
+  const KVCAccessorTable *getAccessorTable(const ObjCContainerDecl *Container);
+  void loadSummary();
+  void writeSummary();
+  void writeKVOGraph();
+  void noteManifestKeyPath(QualType Type, StringRef KeyPath, bool AllowPrivate, bool SingleKey);
+  void writeManifest();
+  void addManifestKeyPath(KeyPathManifestWriter &Writer, QualType Type, StringRef KeyPath, bool AllowPrivate, StringRef AffectedKey);
+  bool isSummaryCurrent(const ObjCContainerDecl *Container);
+  bool loadAccessorTable(KVCAccessorTable *Table, const ObjCContainerDecl *Container, SmallVectorImpl<const ObjCContainerDecl *> &Inherited);
+  QualType getSummaryType(uint32_t Index);
+  uint32_t addSummaryType(KVCSummaryWriter &Writer, QualType Type);
+  NamedDecl *lookupTopLevel(StringRef Name, Decl::Kind Kind);
+  StringRef getFingerprint(const ObjCContainerDecl *Container);
+  void getSummaryStamp(const ObjCContainerDecl *Container, SmallVectorImpl<char> &Out);
+  void addFileStamp(llvm::MD5 &Hash, SourceLocation Loc, bool NameOnly = false);
+  void addDependencies(QualType Type, std::vector<ResultCache::Dependency> &Dependencies);
+  bool areDependenciesCurrent(const std::vector<ResultCache::Dependency> &Dependencies);
+  void makeSiteKey(SmallVectorImpl<char> &Buffer, QualType Type, const Expr *ModelExpr, const Expr *KeyPathExpr, StringRef KeyPath, bool AllowPrivate);
+  void addOwnAccessors(KVCAccessorTable *Table, const ObjCContainerDecl *Container, SmallVectorImpl<const ObjCContainerDecl *> &Inherited);
+  void addContainerAccessors(KVCAccessorTable *Table, const ObjCContainerDecl *Container, bool Private);
+  unsigned getInterfaceClass(const ObjCInterfaceDecl *Interface);
   bool isKVCContainer(QualType type);
   bool isKVCCollectionType(QualType type);
+  bool resolveKeyType(QualType &ObjTypeInOut, StringRef Key, bool AllowPrivate);
 
   void emitDiagnosticsForTypeAndMaybeReceiverAndKeyPath(QualType Type, const Expr *ModelExpr, const Expr *KeyPathExpr, bool AllowPrivate);
-  bool emitDiagnosticsForTypeAndMaybeReceiverAndKey(QualType &ObjTypeInOut, SourceRange ModelRange, StringRef Key, SourceRange KeyRange, size_t Offset, bool AllowPrivate);
+  bool emitDiagnosticsForTypeAndMaybeReceiverAndKey(QualType &ObjTypeInOut, SourceRange ModelRange, StringRef KeyPath, StringRef Key, SourceRange KeyRange, size_t Offset, bool AllowPrivate);
+  void reportInvalidKey(StringRef KeyPath, StringRef Key, StringRef TypeName, QualType Receiver, bool AllowPrivate,
+                        SourceRange ModelRange, SourceRange KeyRange, size_t Offset,
+                        const KeyPathValidationCheck *Check, const ObjCMessageExpr *Send, const Decl *Container);
+  QualType resolveKeyReceiver(QualType Type, StringRef KeyPath, StringRef Key, bool AllowPrivate);
+  StringRef suggestKey(QualType Receiver, StringRef Key, bool AllowPrivate);
+  void addFinding(FindingsWriter::Finding &F, SourceLocation Loc, SourceRange Range);
+  static StringRef getContainerName(const Decl *Container, SmallVectorImpl<char> &Buffer);
+  bool getPropertyAccess(const ObjCMessageExpr *Send, const Expr *KeyPathExpr, std::string &Replacement);
 };
 
 #endif
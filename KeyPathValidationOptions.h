@@ -0,0 +1,98 @@
+//
+// KeyPathValidationOptions.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KEY_PATH_VALIDATION_OPTIONS_H
+#define CLANG_KPV_KEY_PATH_VALIDATION_OPTIONS_H
+
+#include <string>
+#include <vector>
+
+
+// Set from -plugin-arg-validate-key-paths arguments; see README.md.
+struct KeyPathValidationOptions {
+  KeyPathValidationOptions()
+    : SkipSystemHeaders(true)
+    , Streaming(false)
+    , ResolverThreads(1)
+    , PrintStats(false)
+    , WriteFindings(false)
+    , FindingsAsSARIF(false)
+    , WriteKVOGraph(false)
+    , PerfWarnings(false)
+    , WriteManifest(false)
+    , BudgetMs(0), BudgetKeyPaths(0), BudgetStop(false)
+  { }
+
+  // Don't descend into top-level decls located in system headers.
+  bool SkipSystemHeaders;
+
+  // Path prefixes that are always checked (even in system headers) or never checked.
+  std::vector<std::string> AllowPathPrefixes, DenyPathPrefixes;
+
+  // If set, decls in non-main files are only checked by the first TU to claim
+  // the file with a stamp in this directory.
+  std::string HeaderStampDir;
+
+  // KVCSummary of the classes in the included precompiled header, and where
+  // to write one for the classes in this TU. Filled in from the PCH paths
+  // when not given explicitly.
+  std::string SummaryInPath, SummaryOutPath;
+
+  // File of changed line ranges, one "<path>:<first>[-<last>]" per line;
+  // when given, only functions and methods overlapping them are checked.
+  std::string ChangedLinesPath;
+
+  // Directory of results shared between compiles; see ResultCache.
+  std::string ResultCacheDir;
+
+  // Validate each function and @implementation as the parser finishes it,
+  // rather than the whole TU at the end.
+  bool Streaming;
+
+  // Threads to resolve key paths on. With more than one, key paths are
+  // collected during the traversal and resolved together at the end.
+  unsigned ResolverThreads;
+
+  // Extra key path selectors for SelectorRegistry.
+  std::string SelectorsPath;
+
+  // Report counters and times for each TU: as JSON to StatsPath (by default
+  // next to the object file), or on stderr if there's nowhere to put it.
+  bool PrintStats;
+  std::string StatsPath;
+
+  // Write findings as they're made, as JSON Lines or SARIF (see
+  // FindingsWriter): to FindingsPath, by default next to the object file, or
+  // on stdout if there's nowhere to put it.
+  bool WriteFindings;
+  bool FindingsAsSARIF;
+  std::string FindingsPath;
+
+  // Write the KVO dependency graph declared by +keyPathsForValuesAffecting<Key>
+  // (see KVODependencyGraph) to KVOGraphPath, by default next to the object
+  // file, or to stdout.
+  bool WriteKVOGraph;
+  std::string KVOGraphPath;
+
+  // Also warn about valid key paths that are slow at runtime: through to-many
+  // relationships, or sent on every iteration of a loop.
+  bool PerfWarnings;
+
+  // Write every valid literal key path, with the accessors it resolves to,
+  // as a KeyPathManifestWriter manifest to ManifestPath (by default next to
+  // the object file).
+  bool WriteManifest;
+  std::string ManifestPath;
+
+  // Per-TU limits on the time spent validating and the key paths validated;
+  // 0 for none. Past either, only the first key of each key path is
+  // checked, or with BudgetStop, nothing more is.
+  unsigned BudgetMs, BudgetKeyPaths;
+  bool BudgetStop;
+};
+
+#endif
@@ -0,0 +1,104 @@
+//
+// KeyPathValidationStats.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "KeyPathValidationStats.h"
+#include "JSONOutput.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+
+
+void StatsTimer::init(StringRef Name, llvm::TimerGroup *ReportGroup) {
+  this->Name = Name;
+  if (ReportGroup && !ReportTimer)
+    ReportTimer = new llvm::Timer(Name, *ReportGroup);
+}
+
+
+void StatsTimer::start(llvm::TimeRecord &Start) {
+  if (ReportTimer)
+    ReportTimer->startTimer();
+  Start = llvm::TimeRecord::getCurrentTime(/*Start=*/true);
+}
+
+
+void StatsTimer::stop(const llvm::TimeRecord &Start) {
+  llvm::TimeRecord Elapsed = llvm::TimeRecord::getCurrentTime(/*Start=*/false);
+  Elapsed -= Start;
+  Time += Elapsed;
+  if (ReportTimer)
+    ReportTimer->stopTimer();
+}
+
+
+void KeyPathValidationStats::print(llvm::raw_ostream &OS) const {
+  OS << "validate-key-paths: " << MessageSendsMatched << " of " << MessageSendsInspected << " message sends matched; "
+    << KeyPathsValidated << " key paths, " << KeyLookups << " key lookups, " << DiagnosticsEmitted << " diagnostics; "
+    << "key cache " << KeyCacheHits << " hits, " << KeyCacheMisses << " misses; "
+    << "key path prefix cache " << PrefixCacheHits << " hits, " << PrefixCacheMisses << " misses; "
+    << SummaryTablesLoaded << " accessor tables from summary; "
+    << "result cache " << ResultCacheHits << " hits, " << ResultCacheMisses << " misses; "
+    << DeclsStreamed << " decls streamed, " << VisitsDeferred << " visits deferred; "
+    << KeyPathsResolvedInParallel << " key paths resolved in parallel in " << ResolutionWaves << " waves; "
+    << DeclsOutsideChangedLines << " decls outside changed lines; "
+    << PerfWarnings << " perf warnings; "
+    << TranslationUnitsSkipped << " translation units skipped; "
+    << "arenas " << ArenaSlabs << " slabs, " << ArenaBytes << " bytes; "
+    << KeyPathsOverBudget << " key paths over budget\n";
+}
+
+
+void KeyPathValidationStats::printJSON(llvm::raw_ostream &OS, StringRef MainFile, llvm::ArrayRef<const StatsTimer *> Timers) const {
+  OS << "{\n  \"file\": ";
+  printJSONString(OS, MainFile);
+  OS << ",\n"
+    << "  \"message_sends_inspected\": " << MessageSendsInspected << ",\n"
+    << "  \"message_sends_matched\": " << MessageSendsMatched << ",\n"
+    << "  \"key_paths_validated\": " << KeyPathsValidated << ",\n"
+    << "  \"key_lookups\": " << KeyLookups << ",\n"
+    << "  \"diagnostics_emitted\": " << DiagnosticsEmitted << ",\n"
+    << "  \"key_cache_hits\": " << KeyCacheHits << ",\n"
+    << "  \"key_cache_misses\": " << KeyCacheMisses << ",\n"
+    << "  \"prefix_cache_hits\": " << PrefixCacheHits << ",\n"
+    << "  \"prefix_cache_misses\": " << PrefixCacheMisses << ",\n"
+    << "  \"summary_tables_loaded\": " << SummaryTablesLoaded << ",\n"
+    << "  \"result_cache_hits\": " << ResultCacheHits << ",\n"
+    << "  \"result_cache_misses\": " << ResultCacheMisses << ",\n"
+    << "  \"decls_streamed\": " << DeclsStreamed << ",\n"
+    << "  \"visits_deferred\": " << VisitsDeferred << ",\n"
+    << "  \"key_paths_resolved_in_parallel\": " << KeyPathsResolvedInParallel << ",\n"
+    << "  \"resolution_waves\": " << ResolutionWaves << ",\n"
+    << "  \"decls_outside_changed_lines\": " << DeclsOutsideChangedLines << ",\n"
+    << "  \"perf_warnings\": " << PerfWarnings << ",\n"
+    << "  \"translation_units_skipped\": " << TranslationUnitsSkipped << ",\n"
+    << "  \"arena_slabs\": " << ArenaSlabs << ",\n"
+    << "  \"arena_bytes\": " << ArenaBytes << ",\n"
+    << "  \"key_paths_over_budget\": " << KeyPathsOverBudget << ",\n"
+    << "  \"times\": {";
+
+  // Seconds; nested timers (key lookups happen within checks) overlap
+  for (size_t I = 0, E = Timers.size(); I != E; ++I) {
+    const llvm::TimeRecord &Time = Timers[I]->getTime();
+    OS << (I ? ",\n    " : "\n    ");
+    printJSONString(OS, Timers[I]->getName());
+    OS << ": {\"wall\": " << llvm::format("%.6f", Time.getWallTime())
+      << ", \"user\": " << llvm::format("%.6f", Time.getUserTime())
+      << ", \"system\": " << llvm::format("%.6f", Time.getSystemTime()) << "}";
+  }
+  OS << (Timers.empty() ? "}\n" : "\n  }\n") << "}\n";
+}
+
+
+llvm::MemSlab *CountingSlabAllocator::Allocate(size_t Size) {
+  ++Stats.ArenaSlabs;
+  Stats.ArenaBytes += Size;
+  return Heap.Allocate(Size);
+}
+
+
+void CountingSlabAllocator::Deallocate(llvm::MemSlab *Slab) {
+  Heap.Deallocate(Slab);
+}
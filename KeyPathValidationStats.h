@@ -0,0 +1,124 @@
+//
+// KeyPathValidationStats.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_KEY_PATH_VALIDATION_STATS_H
+#define CLANG_KPV_KEY_PATH_VALIDATION_STATS_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Allocator.h"
+#include "llvm/Support/Compiler.h"
+#include "llvm/Support/Timer.h"
+#include <string>
+
+namespace llvm {
+  class raw_ostream;
+}
+
+using llvm::StringRef;
+
+
+// Time spent in one part of the plug-in. Under -ftime-report it's also
+// reported with clang's own timers.
+class StatsTimer {
+public:
+  StatsTimer() : ReportTimer(NULL) { }
+  ~StatsTimer() { delete ReportTimer; }
+
+  void init(StringRef Name, llvm::TimerGroup *ReportGroup);
+  StringRef getName() const { return Name; }
+  const llvm::TimeRecord &getTime() const { return Time; }
+
+  // Times its scope against Timer, unless that's NULL.
+  class Region {
+    StatsTimer *Timer;
+    llvm::TimeRecord Start;
+
+  public:
+    explicit Region(StatsTimer *Timer)
+      : Timer(Timer)
+    {
+      if (Timer)
+        Timer->start(Start);
+    }
+    ~Region() {
+      if (Timer)
+        Timer->stop(Start);
+    }
+  };
+
+private:
+  std::string Name;
+  llvm::TimeRecord Time;
+  llvm::Timer *ReportTimer;
+
+  StatsTimer(const StatsTimer &) LLVM_DELETED_FUNCTION;
+  void operator=(const StatsTimer &) LLVM_DELETED_FUNCTION;
+
+  void start(llvm::TimeRecord &Start);
+  void stop(const llvm::TimeRecord &Start);
+};
+
+
+// Work done for one translation unit. Counters are always kept; times only
+// when asked for, as reading the clock around every check isn't free.
+struct KeyPathValidationStats {
+  KeyPathValidationStats()
+    : MessageSendsInspected(0), MessageSendsMatched(0)
+    , KeyPathsValidated(0), KeyLookups(0), DiagnosticsEmitted(0)
+    , KeyCacheHits(0), KeyCacheMisses(0)
+    , PrefixCacheHits(0), PrefixCacheMisses(0)
+    , SummaryTablesLoaded(0)
+    , ResultCacheHits(0), ResultCacheMisses(0)
+    , DeclsStreamed(0), VisitsDeferred(0)
+    , KeyPathsResolvedInParallel(0), ResolutionWaves(0)
+    , DeclsOutsideChangedLines(0)
+    , PerfWarnings(0)
+    , TranslationUnitsSkipped(0)
+    , ArenaSlabs(0), ArenaBytes(0)
+    , KeyPathsOverBudget(0)
+  { }
+
+  unsigned MessageSendsInspected, MessageSendsMatched;
+  unsigned KeyPathsValidated, KeyLookups, DiagnosticsEmitted;
+  unsigned KeyCacheHits, KeyCacheMisses;
+  unsigned PrefixCacheHits, PrefixCacheMisses;
+  unsigned SummaryTablesLoaded;
+  unsigned ResultCacheHits, ResultCacheMisses;
+  unsigned DeclsStreamed, VisitsDeferred;
+  unsigned KeyPathsResolvedInParallel, ResolutionWaves;
+  unsigned DeclsOutsideChangedLines;
+  unsigned PerfWarnings;
+  unsigned TranslationUnitsSkipped;   // 1 if no check could apply
+  // Slabs the consumer's arenas, which hold its lookup caches, fingerprints
+  // and collected key paths, took from the heap. Nothing else is counted.
+  unsigned ArenaSlabs;
+  size_t ArenaBytes;
+  unsigned KeyPathsOverBudget;        // checked in part, or not at all
+
+  // One line, for -plugin-arg-validate-key-paths stats
+  void print(llvm::raw_ostream &OS) const;
+  // Timers may be empty if times weren't measured.
+  void printJSON(llvm::raw_ostream &OS, StringRef MainFile, llvm::ArrayRef<const StatsTimer *> Timers) const;
+};
+
+
+
+// Takes slabs for a BumpPtrAllocator from the heap, counting them in Stats.
+class CountingSlabAllocator : public llvm::SlabAllocator {
+public:
+  explicit CountingSlabAllocator(KeyPathValidationStats &Stats) : Stats(Stats) { }
+
+  virtual llvm::MemSlab *Allocate(size_t Size) LLVM_OVERRIDE;
+  virtual void Deallocate(llvm::MemSlab *Slab) LLVM_OVERRIDE;
+
+private:
+  KeyPathValidationStats &Stats;
+  llvm::MallocSlabAllocator Heap;
+};
+
+#endif
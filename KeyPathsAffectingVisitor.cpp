@@ -7,18 +7,21 @@
 //
 
 #include "KeyPathsAffectingVisitor.h"
+#include "clang/AST/RecursiveASTVisitor.h"
 
 using namespace clang;
 
 
 class ReturnSetVisitor : public RecursiveASTVisitor<ReturnSetVisitor> {
   KeyPathValidationConsumer *Consumer;
+  const ObjCMethodDecl *Method;
   QualType Type;
   llvm::SmallSet<Selector, 2> *SetConstructorSelectors;
 
 public:
-  ReturnSetVisitor(KeyPathValidationConsumer *Consumer, QualType Type, llvm::SmallSet<Selector, 2> *Selectors)
+  ReturnSetVisitor(KeyPathValidationConsumer *Consumer, const ObjCMethodDecl *Method, QualType Type, llvm::SmallSet<Selector, 2> *Selectors)
     : Consumer(Consumer)
+    , Method(Method)
     , Type(Type)
     , SetConstructorSelectors(Selectors)
   {}
@@ -27,19 +30,18 @@ public:
 };
 
 
-bool KeyPathsAffectingVisitor::VisitObjCMethodDecl(ObjCMethodDecl *D) {
+void KeyPathsAffectingVisitor::VisitObjCMethodDecl(ObjCMethodDecl *D) {
   if (!D->isClassMethod())
-    return true;
+    return;
 
-  std::string Name = D->getNameAsString();
-  if (Name.length() <= Prefix.length() || !std::equal(Prefix.begin(), Prefix.end(), Name.begin()))
-    return true;
+  // Points into the identifier table, where getNameAsString would copy it
+  StringRef Name = D->getSelector().getNameForSlot(0);
+  if (Name.size() <= Prefix.size() || !Name.startswith(Prefix))
+    return;
 
   ASTContext &Context = Compiler.getASTContext();
   QualType Type = Context.getObjCObjectPointerType(Context.getObjCInterfaceType(D->getClassInterface()));
-  ReturnSetVisitor(Consumer, Type, &SetConstructorSelectors).TraverseDecl(D);
-
-  return true;
+  ReturnSetVisitor(Consumer, D, Type, &SetConstructorSelectors).TraverseDecl(D);
 }
 
 
@@ -52,12 +54,15 @@ bool ReturnSetVisitor::VisitStmt(const Stmt *Node) {
   if (!E)
     return true;
 
-  QualType ClassReceiver = E->getClassReceiver();
-  if (ClassReceiver.isNull() || ClassReceiver.getAsString() != "NSSet")
+  if (E->getReceiverKind() != ObjCMessageExpr::Class)
+    return true;
+  const ObjCInterfaceDecl *ClassReceiver = E->getReceiverInterface();
+  if (!ClassReceiver || ClassReceiver->getName() != "NSSet")
     return true;
 
   if (!SetConstructorSelectors->count(E->getSelector()))
     return true;
+  Consumer->noteMatchedMessageSend();
 
   for (unsigned I = 0, N = E->getNumArgs(); I < N; ++I)
   {
@@ -67,9 +72,7 @@ bool ReturnSetVisitor::VisitStmt(const Stmt *Node) {
       continue;
 
     Consumer->emitDiagnosticsForTypeAndKeyPath(Type, Arg, true);
-
-    const StringRef KeyPathString = KeyPathLiteral->getString()->getString();
-    llvm::outs() << KeyPathString << ", ";
+    Consumer->noteAffectingKeyPath(Method, KeyPathLiteral);
   }
 
   return true;
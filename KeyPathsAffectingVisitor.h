@@ -10,16 +10,17 @@
 #define CLANG_KPV_KEY_PATHS_AFFECTING_VISITOR_H
 
 #include "KeyPathValidationConsumer.h"
-#include "clang/AST/RecursiveASTVisitor.h"
+#include "KeyPathValidationCheck.h"
 #include "clang/Frontend/CompilerInstance.h"
+#include "llvm/ADT/SmallSet.h"
 
 using namespace clang;
 
 
-class KeyPathsAffectingVisitor : public RecursiveASTVisitor<KeyPathsAffectingVisitor> {
+class KeyPathsAffectingVisitor : public KeyPathValidationCheck {
   KeyPathValidationConsumer *Consumer;
   const CompilerInstance &Compiler;
-  std::string Prefix;
+  StringRef Prefix;
   llvm::SmallSet<Selector, 2> SetConstructorSelectors;
   //RecursiveASTVisitor Visitor;
 
@@ -34,10 +35,12 @@ public:
     SetConstructorSelectors.insert(Ctx.Selectors.getUnarySelector(&Ctx.Idents.get("setWithObjects")));
   }
 
-  bool shouldVisitTemplateInstantiations() const { return false; }
-  bool shouldWalkTypesOfTypeLocs() const { return false; }
-
-  bool VisitObjCMethodDecl(ObjCMethodDecl *D);
+  virtual const char *getName() const { return "key-paths-affecting"; }
+  virtual void VisitObjCMethodDecl(ObjCMethodDecl *D);
+  virtual bool getTriggerIdentifiers(llvm::StringSet<> &Names, SmallVectorImpl<StringRef> &Prefixes) const {
+    Prefixes.push_back(Prefix);
+    return true;
+  }
 };
 
 #endif
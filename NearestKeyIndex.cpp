@@ -0,0 +1,60 @@
+//
+// NearestKeyIndex.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "NearestKeyIndex.h"
+
+using namespace clang;
+
+
+NearestKeyIndex::NearestKeyIndex(const KVCAccessorTable &Table) {
+  for (KVCAccessorTable::slot_iterator Slot = Table.slot_begin(), SlotEnd = Table.slot_end(); Slot != SlotEnd; ++Slot) {
+    if (Slot->second.Any.Kind == KVCAccessorTable::AK_None)
+      continue;
+    StringRef Key = Slot->getKey();
+    if (ByLength.size() <= Key.size())
+      ByLength.resize(Key.size() + 1);
+    Candidate C = { Key, Slot->second.Public.Kind != KVCAccessorTable::AK_None };
+    ByLength[Key.size()].push_back(C);
+  }
+}
+
+
+// Nearer lengths first: a key N characters longer or shorter is at least N
+// edits away, so once N reaches the best distance found, nothing further out
+// can be better.
+void NearestKeyIndex::findNearest(StringRef Typo, bool AllowPrivate, StringRef &Nearest, unsigned &Distance) const {
+  for (size_t Delta = 0; Delta < Distance; ++Delta) {
+    if (Typo.size() + Delta < ByLength.size())
+      findNearestOfLength(Typo.size() + Delta, Typo, AllowPrivate, Nearest, Distance);
+    if (Delta && Delta <= Typo.size() && Typo.size() - Delta < ByLength.size())
+      findNearestOfLength(Typo.size() - Delta, Typo, AllowPrivate, Nearest, Distance);
+  }
+}
+
+
+void NearestKeyIndex::findNearestOfLength(size_t Length, StringRef Typo, bool AllowPrivate, StringRef &Nearest, unsigned &Distance) const {
+  const std::vector<Candidate> &Candidates = ByLength[Length];
+  for (std::vector<Candidate>::const_iterator C = Candidates.begin(), CEnd = Candidates.end(); C != CEnd; ++C) {
+    if (!AllowPrivate && !C->Public)
+      continue;
+    if (Distance == 0)
+      return;
+    // Only a different case, as in "url" for "URL"
+    if (Length == Typo.size() && C->Key.equals_lower(Typo)) {
+      Nearest = C->Key;
+      Distance = 0;
+      return;
+    }
+    // Ties go to the first key alphabetically, so suggestions don't depend
+    // on hash order
+    unsigned D = Typo.edit_distance(C->Key, /*AllowReplacements=*/true, Distance);
+    if (D < Distance || (D == Distance && !Nearest.empty() && C->Key < Nearest)) {
+      Nearest = C->Key;
+      Distance = D;
+    }
+  }
+}
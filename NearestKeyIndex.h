@@ -0,0 +1,44 @@
+//
+// NearestKeyIndex.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_NEAREST_KEY_INDEX_H
+#define CLANG_KPV_NEAREST_KEY_INDEX_H
+
+#include "KVCAccessorTable.h"
+#include "llvm/ADT/StringRef.h"
+#include <vector>
+
+using llvm::StringRef;
+
+
+// The keys of one KVCAccessorTable grouped by length, for suggesting a key
+// when one isn't found. Only built for tables a diagnostic is reported
+// against. Keys are compared by edit distance, bounded so that comparing
+// against a key stops as soon as it can't beat the best so far, and keys
+// whose length alone puts them out of reach aren't looked at.
+class NearestKeyIndex {
+public:
+  explicit NearestKeyIndex(const KVCAccessorTable &Table);
+
+  // Replaces Nearest with the key closest to Typo, if it's fewer than
+  // Distance edits away, and updates Distance. Keys differing from Typo only
+  // in case are closest of all. Start with Distance one more than the most
+  // edits allowed; it carries over between indexes, as a receiver can have
+  // several (its class and qualifying protocols).
+  void findNearest(StringRef Typo, bool AllowPrivate, StringRef &Nearest, unsigned &Distance) const;
+
+private:
+  struct Candidate {
+    StringRef Key;    // owned by the table
+    bool Public;
+  };
+  std::vector<std::vector<Candidate> > ByLength;
+
+  void findNearestOfLength(size_t Length, StringRef Typo, bool AllowPrivate, StringRef &Nearest, unsigned &Distance) const;
+};
+
+#endif
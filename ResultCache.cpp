@@ -0,0 +1,129 @@
+//
+// ResultCache.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "ResultCache.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using llvm::SmallString;
+
+
+// Entries are lines of text:
+//
+//   kpv-result 1
+//   valid                   or: invalid <key offset> <key length>
+//                               <type name>
+//   <number of dependencies>
+//   class|protocol <name>   } for each dependency
+//   <fingerprint>           }
+static const char ResultHeader[] = "kpv-result 1";
+
+
+std::string ResultCache::getEntryPath(StringRef SiteKey) const {
+  llvm::MD5 Hash;
+  Hash.update(SiteKey);
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+
+  SmallString<256> Path(Directory);
+  llvm::sys::path::append(Path, Digest.str() + ".kpvresult");
+  return Path.str();
+}
+
+
+static bool nextLine(StringRef &Remaining, StringRef &Line) {
+  if (Remaining.empty())
+    return false;
+  llvm::tie(Line, Remaining) = Remaining.split('\n');
+  return true;
+}
+
+
+bool ResultCache::lookup(StringRef SiteKey, Result &Out) const {
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  if (llvm::MemoryBuffer::getFile(getEntryPath(SiteKey), Buffer))
+    return false;
+
+  StringRef Remaining = Buffer->getBuffer(), Line;
+  if (!nextLine(Remaining, Line) || Line != ResultHeader)
+    return false;
+
+  if (!nextLine(Remaining, Line))
+    return false;
+  Out = Result();
+  if (Line.startswith("invalid ")) {
+    StringRef Offset, Length;
+    llvm::tie(Offset, Length) = Line.substr(8).split(' ');
+    if (Offset.getAsInteger(10, Out.KeyOffset) || Length.getAsInteger(10, Out.KeyLength))
+      return false;
+    if (!nextLine(Remaining, Line))
+      return false;
+    Out.Valid = false;
+    Out.TypeName = Line;
+  } else if (Line != "valid")
+    return false;
+
+  unsigned NumDependencies;
+  if (!nextLine(Remaining, Line) || Line.getAsInteger(10, NumDependencies))
+    return false;
+  for (unsigned I = 0; I < NumDependencies; ++I) {
+    Dependency D;
+    StringRef Kind, Name;
+    if (!nextLine(Remaining, Line))
+      return false;
+    llvm::tie(Kind, Name) = Line.split(' ');
+    if (Kind != "class" && Kind != "protocol")
+      return false;
+    D.IsProtocol = Kind == "protocol";
+    D.Name = Name;
+    if (!nextLine(Remaining, Line))
+      return false;
+    D.Fingerprint = Line;
+    Out.Dependencies.push_back(D);
+  }
+  return true;
+}
+
+
+void ResultCache::store(StringRef SiteKey, const Result &R) const {
+  std::string EntryPath = getEntryPath(SiteKey);
+
+  int FD;
+  SmallString<256> TempPath;
+  if (llvm::sys::fs::createUniqueFile(EntryPath + "-%%%%%%%%", FD, TempPath))
+    return; // an unwritable cache only costs time
+
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << ResultHeader << '\n';
+    if (R.Valid)
+      OS << "valid\n";
+    else
+      OS << "invalid " << R.KeyOffset << ' ' << R.KeyLength << '\n' << R.TypeName << '\n';
+    OS << R.Dependencies.size() << '\n';
+    for (std::vector<Dependency>::const_iterator D = R.Dependencies.begin(), DEnd = R.Dependencies.end(); D != DEnd; ++D)
+      OS << (D->IsProtocol ? "protocol " : "class ") << D->Name << '\n' << D->Fingerprint << '\n';
+
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(TempPath.str());
+      return;
+    }
+  }
+
+  if (llvm::sys::fs::rename(TempPath.str(), EntryPath))
+    llvm::sys::fs::remove(TempPath.str());
+}
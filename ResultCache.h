@@ -0,0 +1,59 @@
+//
+// ResultCache.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_RESULT_CACHE_H
+#define CLANG_KPV_RESULT_CACHE_H
+
+#include "llvm/ADT/StringRef.h"
+#include <string>
+#include <vector>
+
+using llvm::StringRef;
+
+
+// Directory of key path validation results shared by all compiles, one file
+// per key path site, named by a hash of the site. A result records the
+// classes and protocols it was resolved against with a fingerprint of their
+// declarations, and is only replayed while those fingerprints still match.
+//
+// Entries are written to a unique temporary file and renamed into place, so
+// any number of processes can read and write the directory at once; the
+// last writer of an entry wins.
+class ResultCache {
+public:
+  struct Dependency {
+    std::string Name;
+    bool IsProtocol;
+    std::string Fingerprint;
+  };
+
+  struct Result {
+    Result() : Valid(true), KeyOffset(0), KeyLength(0) { }
+
+    bool Valid;
+    // If not valid, the first key not found (at an offset into the string
+    // literal, quotes included) and the type it was looked up on.
+    unsigned KeyOffset, KeyLength;
+    std::string TypeName;
+    std::vector<Dependency> Dependencies;
+  };
+
+  explicit ResultCache(StringRef Directory)
+    : Directory(Directory)
+  { }
+
+  // SiteKey is any string identifying the site; it's hashed for the file name.
+  bool lookup(StringRef SiteKey, Result &Out) const;
+  void store(StringRef SiteKey, const Result &R) const;
+
+private:
+  std::string Directory;
+
+  std::string getEntryPath(StringRef SiteKey) const;
+};
+
+#endif
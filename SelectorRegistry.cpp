@@ -0,0 +1,148 @@
+//
+// SelectorRegistry.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "SelectorRegistry.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <algorithm>
+
+using namespace clang;
+
+
+static const char BuiltinSelectors[] =
+  "# NSKeyValueCoding\n"
+  "valueForKey:                                      receiver 0 key\n"
+  "valueForKeyPath:                                  receiver 0 keypath\n"
+  "setValue:forKey:                                  receiver 1 key\n"
+  "setValue:forKeyPath:                              receiver 1 keypath\n"
+  "mutableArrayValueForKey:                          receiver 0 key\n"
+  "mutableArrayValueForKeyPath:                      receiver 0 keypath\n"
+  "mutableOrderedSetValueForKey:                     receiver 0 key\n"
+  "mutableOrderedSetValueForKeyPath:                 receiver 0 keypath\n"
+  "mutableSetValueForKey:                            receiver 0 key\n"
+  "mutableSetValueForKeyPath:                        receiver 0 keypath\n"
+  "# NSKeyValueObserving\n"
+  "addObserver:forKeyPath:options:context:           receiver 1 keypath\n"
+  "removeObserver:forKeyPath:                        receiver 1 keypath\n"
+  "removeObserver:forKeyPath:context:                receiver 1 keypath\n"
+  "willChangeValueForKey:                            receiver 0 key\n"
+  "didChangeValueForKey:                             receiver 0 key\n"
+  "# NSKeyValueBindingCreation\n"
+  "bind:toObject:withKeyPath:options:                1 2 keypath\n"
+  "# FBBinder\n"
+  "bindToModel:keyPath:change:                       0 1 keypath\n"
+  "bindToModels:keyPaths:change:                     0 1 bindings\n";
+
+
+SelectorRegistry::SelectorRegistry(ASTContext &Context)
+  : Context(Context)
+{ }
+
+
+void SelectorRegistry::addBuiltins() {
+  std::string Error;
+  bool Added = addLines(BuiltinSelectors, "built-in selectors", Error);
+  assert(Added && "invalid built-in selector table");
+  (void)Added;
+}
+
+
+bool SelectorRegistry::loadFile(StringRef Path, std::string &Error) {
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  if (llvm::error_code EC = llvm::MemoryBuffer::getFile(Path, Buffer)) {
+    Error = (Twine("can't read ") + Path + ": " + EC.message()).str();
+    return false;
+  }
+  return addLines(Buffer->getBuffer(), Path, Error);
+}
+
+
+bool SelectorRegistry::addLines(StringRef Lines, StringRef SourceName, std::string &Error) {
+  unsigned LineNumber = 0;
+  while (!Lines.empty()) {
+    StringRef Line;
+    llvm::tie(Line, Lines) = Lines.split('\n');
+    ++LineNumber;
+
+    std::string LineError;
+    if (!addLine(Line, LineError)) {
+      Error = (SourceName + ":" + Twine(LineNumber) + ": " + LineError).str();
+      return false;
+    }
+  }
+  return true;
+}
+
+
+bool SelectorRegistry::addLine(StringRef Line, std::string &Error) {
+  std::string Normalized = Line.substr(0, Line.find('#'));
+  std::replace(Normalized.begin(), Normalized.end(), '\t', ' ');
+  std::replace(Normalized.begin(), Normalized.end(), '\r', ' ');
+  SmallVector<StringRef, 4> Fields;
+  StringRef(Normalized).split(Fields, " ", -1, /*KeepEmpty=*/false);
+  if (Fields.empty())
+    return true;
+  if (Fields.size() != 4) {
+    Error = "expected '<selector> <model> <key argument> <kind>'";
+    return false;
+  }
+
+  StringRef Name = Fields[0];
+  unsigned NumArgs = Name.count(':');
+  if (NumArgs == 0 || !Name.endswith(":")) {
+    Error = "selector '" + Name.str() + "' takes no arguments";
+    return false;
+  }
+  SmallVector<IdentifierInfo *, 4> Pieces;
+  for (StringRef Rest = Name; !Rest.empty(); ) {
+    StringRef Piece;
+    llvm::tie(Piece, Rest) = Rest.split(':');
+    Pieces.push_back(Piece.empty() ? NULL : &Context.Idents.get(Piece));
+  }
+
+  Entry E;
+  if (Fields[1] == "receiver")
+    E.ModelArgument = ReceiverArgument;
+  else {
+    unsigned ModelArgument;
+    if (Fields[1].getAsInteger(10, ModelArgument) || ModelArgument >= NumArgs) {
+      Error = "model must be 'receiver' or an argument index";
+      return false;
+    }
+    E.ModelArgument = ModelArgument;
+  }
+  if (Fields[2].getAsInteger(10, E.KeyArgument) || E.KeyArgument >= NumArgs || int(E.KeyArgument) == E.ModelArgument) {
+    Error = "key argument must be an argument index other than the model's";
+    return false;
+  }
+
+  StringRef Kind = Fields[3];
+  if (Kind == "key")
+    E.Kind = KK_Key;
+  else if (Kind == "keypath")
+    E.Kind = KK_KeyPath;
+  else if (Kind == "keypaths")
+    E.Kind = KK_KeyPathArray;
+  else if (Kind == "bindings" && E.ModelArgument != ReceiverArgument)
+    E.Kind = KK_Bindings;
+  else {
+    Error = "kind must be key, keypath, keypaths or bindings (which needs a model argument)";
+    return false;
+  }
+
+  Entries[Context.Selectors.getSelector(NumArgs, Pieces.data())] = E;
+  return true;
+}
+
+
+void SelectorRegistry::getLeadingIdentifiers(llvm::StringSet<> &Names) const {
+  for (llvm::DenseMap<Selector, Entry>::const_iterator I = Entries.begin(), E = Entries.end(); I != E; ++I)
+    Names.insert(I->first.getNameForSlot(0));
+}
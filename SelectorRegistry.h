@@ -0,0 +1,78 @@
+//
+// SelectorRegistry.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_SELECTOR_REGISTRY_H
+#define CLANG_KPV_SELECTOR_REGISTRY_H
+
+#include "clang/AST/ASTContext.h"
+#include "clang/Basic/IdentifierTable.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSet.h"
+#include <string>
+
+using namespace clang;
+
+
+// Selectors taking a key or key path, and which of their arguments hold the
+// key and the object it applies to. Built from lines of the form
+//
+//   <selector> <model> <key argument> <kind>
+//
+// where <model> is "receiver" or an argument index, <key argument> is an
+// argument index, and <kind> is one of
+//
+//   key        a single key
+//   keypath    a key path
+//   keypaths   an array literal of key paths, all applying to the model
+//   bindings   an array literal of arrays of key paths, each applying to
+//              the corresponding element of the model argument, itself an
+//              array literal (as with -bindToModels:keyPaths:change:)
+//
+// Blank lines and anything after '#' are ignored. The built-in table covers
+// Foundation, AppKit bindings and FBBinder; a file given with
+// -plugin-arg-validate-key-paths selectors=<path> adds to or overrides it.
+class SelectorRegistry {
+public:
+  enum KeyKind {
+    KK_Key,
+    KK_KeyPath,
+    KK_KeyPathArray,
+    KK_Bindings
+  };
+
+  static const int ReceiverArgument = -1;
+
+  struct Entry {
+    int ModelArgument;
+    unsigned KeyArgument;
+    KeyKind Kind;
+  };
+
+  explicit SelectorRegistry(ASTContext &Context);
+
+  void addBuiltins();
+  bool addLines(StringRef Lines, StringRef SourceName, std::string &Error);
+  bool loadFile(StringRef Path, std::string &Error);
+
+  // The only question asked of every message send, so a single hash lookup.
+  const Entry *lookup(Selector Sel) const {
+    llvm::DenseMap<Selector, Entry>::const_iterator Found = Entries.find(Sel);
+    return Found == Entries.end() ? NULL : &Found->second;
+  }
+
+  // The first piece of each selector (valueForKey, addObserver, ...)
+  void getLeadingIdentifiers(llvm::StringSet<> &Names) const;
+
+private:
+  ASTContext &Context;
+  llvm::DenseMap<Selector, Entry> Entries;
+
+  bool addLine(StringRef Line, std::string &Error);
+};
+
+#endif
@@ -0,0 +1,247 @@
+//
+// TraversalFilter.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#include "TraversalFilter.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclObjC.h"
+#include "clang/Basic/CharInfo.h"
+#include "clang/Basic/FileManager.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace clang;
+
+
+static bool hasAnyPrefix(StringRef Path, const std::vector<std::string> &Prefixes) {
+  for (std::vector<std::string>::const_iterator Prefix = Prefixes.begin(), PrefixEnd = Prefixes.end();
+      Prefix != PrefixEnd; ++Prefix)
+    if (Path.startswith(*Prefix))
+      return true;
+  return false;
+}
+
+
+bool TraversalFilter::shouldTraverseTopLevelDecl(const Decl *D) {
+  const DeclContext *DC = D->getDeclContext();
+  if (!DC || !DC->getRedeclContext()->isTranslationUnit())
+    return true;
+
+  SourceLocation Loc = SM.getExpansionLoc(D->getLocation());
+  if (Loc.isInvalid())
+    return true;
+
+  const FileEntry *File = SM.getFileEntryForID(SM.getFileID(Loc));
+  if (!File)
+    return true;
+
+  llvm::DenseMap<const FileEntry *, bool>::iterator Cached = FileDecisions.find(File);
+  if (Cached != FileDecisions.end())
+    return Cached->second;
+
+  bool Traverse = shouldTraverseFile(File, Loc);
+  FileDecisions[File] = Traverse;
+  return Traverse;
+}
+
+
+bool TraversalFilter::shouldTraverseFile(const FileEntry *File, SourceLocation Loc) {
+  StringRef Path = File->getName();
+  if (hasAnyPrefix(Path, Options.DenyPathPrefixes))
+    return false;
+  if (hasAnyPrefix(Path, Options.AllowPathPrefixes))
+    return true;
+
+  if (Options.SkipSystemHeaders && SM.isInSystemHeader(Loc))
+    return false;
+
+  if (!Options.HeaderStampDir.empty() && File != SM.getFileEntryForID(SM.getMainFileID()))
+    return claimHeaderStamp(File);
+
+  return true;
+}
+
+
+// A header is claimed by creating its stamp exclusively, so concurrent
+// compiles agree on a single owner. The stamp name covers the header's size
+// and modification time, so an edited header is checked again. The stamp
+// also names the main file that claimed it, and that TU checks the header
+// every time it's compiled: an incremental rebuild keeps the header's
+// warnings, and as the owner includes everything the header's key paths are
+// resolved against, a change to any of it rebuilds the owner, which checks
+// the header again.
+bool TraversalFilter::claimHeaderStamp(const FileEntry *File) {
+  llvm::MD5 Hash;
+  Hash.update(File->getName());
+  time_t ModTime = File->getModificationTime();
+  off_t Size = File->getSize();
+  Hash.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&ModTime), sizeof(ModTime)));
+  Hash.update(ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(&Size), sizeof(Size)));
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Digest;
+  llvm::MD5::stringifyResult(Result, Digest);
+
+  SmallString<256> StampPath(Options.HeaderStampDir);
+  llvm::sys::path::append(StampPath, Digest.str() + ".stamp");
+
+  const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+  StringRef MainPath = MainFile ? MainFile->getName() : StringRef();
+  int FD;
+  llvm::error_code EC = llvm::sys::fs::openFileForWrite(StampPath.str(), FD, llvm::sys::fs::F_Excl);
+  if (EC == llvm::errc::file_exists)
+    return isStampOwner(StampPath, MainPath);
+  if (EC)
+    return true; // can't coordinate; err on the side of checking
+
+  llvm::raw_fd_ostream Stamp(FD, /*shouldClose=*/true);
+  Stamp << File->getName() << '\n' << MainPath << '\n';
+  return true;
+}
+
+
+// A stamp still being written reads as someone else's, which it is.
+bool TraversalFilter::isStampOwner(StringRef StampPath, StringRef MainPath) {
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  if (MainPath.empty() || llvm::MemoryBuffer::getFile(StampPath, Buffer))
+    return false;
+  StringRef Owner = Buffer->getBuffer().split('\n').second.split('\n').first;
+  if (Owner.empty())
+    return false;
+  bool Same = false;
+  return Owner == MainPath || (!llvm::sys::fs::equivalent(Owner, MainPath, Same) && Same);
+}
+
+
+// Paths are looked up through the FileManager, which identifies files by
+// inode, so it doesn't matter whether the compile spells them the same way.
+// Files that no longer exist (deleted in the diff) are ignored.
+bool TraversalFilter::loadChangedLines(std::string &Error) {
+  if (Options.ChangedLinesPath.empty())
+    return true;
+
+  llvm::OwningPtr<llvm::MemoryBuffer> Buffer;
+  if (llvm::error_code EC = llvm::MemoryBuffer::getFile(Options.ChangedLinesPath, Buffer)) {
+    Error = EC.message();
+    return false;
+  }
+
+  FileManager &Files = SM.getFileManager();
+  unsigned LineNumber = 0;
+  for (StringRef Rest = Buffer->getBuffer(); !Rest.empty(); ) {
+    StringRef Line;
+    llvm::tie(Line, Rest) = Rest.split('\n');
+    ++LineNumber;
+    Line = Line.trim();
+    if (Line.empty())
+      continue;
+
+    // Split at the last colon, so that paths may contain colons
+    size_t Colon = Line.rfind(':');
+    StringRef First, Last;
+    if (Colon != StringRef::npos)
+      llvm::tie(First, Last) = Line.substr(Colon + 1).split('-');
+    unsigned FirstLine, LastLine;
+    bool Valid = Colon != StringRef::npos && !First.getAsInteger(10, FirstLine);
+    if (Valid && Last.empty())
+      LastLine = FirstLine;
+    else if (Valid)
+      Valid = !Last.getAsInteger(10, LastLine) && LastLine >= FirstLine;
+    if (!Valid) {
+      Error = (Twine("line ") + Twine(LineNumber) + ": expected '<path>:<first>[-<last>]'").str();
+      return false;
+    }
+
+    if (const FileEntry *File = Files.getFile(Line.substr(0, Colon)))
+      ChangedLines[File].push_back(std::make_pair(FirstLine, LastLine));
+  }
+
+  HasChangedLines = true;
+  return true;
+}
+
+
+bool TraversalFilter::overlapsChangedLines(const Decl *D) {
+  if (!HasChangedLines || !(isa<FunctionDecl>(D) || isa<ObjCMethodDecl>(D)))
+    return true;
+
+  SourceRange Range = D->getSourceRange();
+  SourceLocation Begin = SM.getExpansionLoc(Range.getBegin()), End = SM.getExpansionLoc(Range.getEnd());
+  if (Begin.isInvalid())
+    return true;
+  const FileEntry *File = SM.getFileEntryForID(SM.getFileID(Begin));
+  if (!File)
+    return true;
+
+  llvm::DenseMap<const FileEntry *, LineRanges>::const_iterator Ranges = ChangedLines.find(File);
+  if (Ranges == ChangedLines.end())
+    return false;
+  unsigned FirstLine = SM.getExpansionLineNumber(Begin), LastLine = End.isValid() ? SM.getExpansionLineNumber(End) : FirstLine;
+  for (LineRanges::const_iterator Changed = Ranges->second.begin(), ChangedEnd = Ranges->second.end(); Changed != ChangedEnd; ++Changed)
+    if (Changed->first <= LastLine && FirstLine <= Changed->second)
+      return true;
+  return false;
+}
+
+
+static bool mentionsIdentifier(StringRef Text, const llvm::StringSet<> &Names, ArrayRef<StringRef> Prefixes) {
+  for (const char *P = Text.begin(), *End = Text.end(); P != End; ) {
+    if (!isIdentifierHead(*P)) {
+      ++P;
+      continue;
+    }
+    const char *Start = P;
+    while (P != End && isIdentifierBody(*P))
+      ++P;
+    StringRef Identifier(Start, P - Start);
+    if (Names.count(Identifier))
+      return true;
+    for (ArrayRef<StringRef>::iterator Prefix = Prefixes.begin(), PrefixEnd = Prefixes.end(); Prefix != PrefixEnd; ++Prefix)
+      if (Identifier.startswith(*Prefix))
+        return true;
+  }
+  return false;
+}
+
+
+// Header stamps aren't claimed here; a header whose stamp is taken is
+// scanned anyway, which only makes the answer more cautious.
+bool TraversalFilter::mayMentionIdentifier(const llvm::StringSet<> &Names, ArrayRef<StringRef> Prefixes) {
+  llvm::SmallPtrSet<const SrcMgr::ContentCache *, 32> Scanned;
+  unsigned LocalCount = SM.local_sloc_entry_size(), LoadedCount = SM.loaded_sloc_entry_size();
+  for (unsigned I = 0; I != LocalCount + LoadedCount; ++I) {
+    bool Invalid = false;
+    const SrcMgr::SLocEntry &Entry = I < LocalCount ? SM.getLocalSLocEntry(I, &Invalid) : SM.getLoadedSLocEntry(I - LocalCount, &Invalid);
+    if (Invalid)
+      return true;
+    if (!Entry.isFile())
+      continue;
+    const SrcMgr::ContentCache *Content = Entry.getFile().getContentCache();
+    if (!Scanned.insert(Content))
+      continue;
+
+    if (const FileEntry *File = Content->OrigEntry) {
+      if (hasAnyPrefix(File->getName(), Options.DenyPathPrefixes))
+        continue;
+      if (Options.SkipSystemHeaders && Entry.getFile().getFileCharacteristic() != SrcMgr::C_User &&
+          !hasAnyPrefix(File->getName(), Options.AllowPathPrefixes))
+        continue;
+    }
+
+    const llvm::MemoryBuffer *Buffer = Content->getBuffer(SM.getDiagnostics(), SM, SourceLocation(), &Invalid);
+    if (Invalid || mentionsIdentifier(Buffer->getBuffer(), Names, Prefixes))
+      return true;
+  }
+  return false;
+}
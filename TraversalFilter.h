@@ -0,0 +1,62 @@
+//
+// TraversalFilter.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_TRAVERSAL_FILTER_H
+#define CLANG_KPV_TRAVERSAL_FILTER_H
+
+#include "KeyPathValidationOptions.h"
+#include "clang/AST/DeclBase.h"
+#include "clang/Basic/SourceManager.h"
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringSet.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace clang;
+
+
+// Decides which top-level decls are worth traversing. Decisions are made per
+// file, so each header is only examined once per TU.
+class TraversalFilter {
+  const SourceManager &SM;
+  const KeyPathValidationOptions &Options;
+  llvm::DenseMap<const FileEntry *, bool> FileDecisions;
+
+  // Line ranges from Options.ChangedLinesPath, once loaded
+  typedef std::vector<std::pair<unsigned, unsigned> > LineRanges;
+  bool HasChangedLines;
+  llvm::DenseMap<const FileEntry *, LineRanges> ChangedLines;
+
+  bool shouldTraverseFile(const FileEntry *File, SourceLocation Loc);
+  bool claimHeaderStamp(const FileEntry *File);
+  bool isStampOwner(StringRef StampPath, StringRef MainPath);
+
+public:
+  TraversalFilter(const SourceManager &SM, const KeyPathValidationOptions &Options)
+    : SM(SM)
+    , Options(Options)
+    , HasChangedLines(false)
+  { }
+
+  bool shouldTraverseTopLevelDecl(const Decl *D);
+
+  // Reads Options.ChangedLinesPath, if set. Until it has been read (or if it
+  // can't be), every function and method is in scope.
+  bool loadChangedLines(std::string &Error);
+  // False for a function or method that doesn't overlap a changed line.
+  bool overlapsChangedLines(const Decl *D);
+
+  // Whether the text of any file that might be traversed (including those
+  // from a precompiled header) contains one of Names as an identifier, or
+  // an identifier starting with one of Prefixes. Comments and strings count
+  // too; there's no lexing, just one pass over each file's buffer.
+  bool mayMentionIdentifier(const llvm::StringSet<> &Names, ArrayRef<StringRef> Prefixes);
+};
+
+#endif
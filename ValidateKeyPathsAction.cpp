@@ -7,20 +7,325 @@
 //
 
 #include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Lex/PreprocessorOptions.h"
 #include "KeyPathValidationConsumer.h"
-#include "ValueForKeyVisitor.h"
+#include "CheckDispatchVisitor.h"
+#include "TraversalFilter.h"
+#include "KeyPathArgumentVisitor.h"
 #include "KeyPathsAffectingVisitor.h"
-#include "FitbitFBBinderVisitor.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
 
 using namespace clang;
 
 
-void KeyPathValidationConsumer::HandleTranslationUnit(ASTContext &Context) {
+void KeyPathValidationConsumer::beginValidation() {
+  if (ValidationStarted)
+    return;
+  ValidationStarted = true;
+
   cacheNSTypes();
+  loadSummary();
+  startTiming();
+
+  if (!Filter)
+    Filter.reset(new TraversalFilter(Context.getSourceManager(), Options));
+  std::string ChangedLinesError;
+  if (!Filter->loadChangedLines(ChangedLinesError)) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't read changed lines '%0', checking everything: %1")) << Options.ChangedLinesPath << ChangedLinesError;
+  }
+  Dispatcher.reset(new CheckDispatchVisitor(Checks, Filter.get(), &Stats, CheckTimers.get(), this));
+  openFindings();
+}
+
+
+void KeyPathValidationConsumer::openFindings() {
+  if (!Options.WriteFindings)
+    return;
+  std::string Error;
+  Findings.reset(FindingsWriter::create(Options.FindingsPath, Options.FindingsAsSARIF ? FindingsWriter::FF_SARIF : FindingsWriter::FF_JSONLines, Error));
+  if (!Findings) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write key path findings '%0': %1")) << Options.FindingsPath << Error;
+  }
+}
+
+
+// Most translation units never send a key path selector nor define
+// +keyPathsForValuesAffecting<Key>. Scanning the text of the files that
+// would be traversed for the identifiers the checks need is much cheaper
+// than setting up (NS types, summaries, timers) and walking every decl.
+bool KeyPathValidationConsumer::mayNeedValidation() {
+  llvm::StringSet<> Names;
+  SmallVector<StringRef, 4> Prefixes;
+  for (SmallVectorImpl<KeyPathValidationCheck *>::const_iterator Check = Checks.begin(), CheckEnd = Checks.end(); Check != CheckEnd; ++Check)
+    if (!(*Check)->getTriggerIdentifiers(Names, Prefixes))
+      return true;
+
+  Filter.reset(new TraversalFilter(Context.getSourceManager(), Options));
+  return Filter->mayMentionIdentifier(Names, Prefixes);
+}
+
+
+// Streaming validates function bodies and @implementations as they're parsed.
+// Whatever they refer to is declared by then, but categories, class
+// extensions and protocol conformances can still add keys further down the
+// TU, and a forward-declared class may not have its @interface yet. So a key
+// that isn't found is held back, and its check run again at the end.
+bool KeyPathValidationConsumer::HandleTopLevelDecl(DeclGroupRef DG) {
+  if (!Options.Streaming)
+    return true;
+  beginValidation();
+
+  DeferInvalidKeys = true;
+  for (DeclGroupRef::iterator I = DG.begin(), E = DG.end(); I != E; ++I) {
+    Decl *D = *I;
+    if (const ObjCContainerDecl *Container = dyn_cast<ObjCContainerDecl>(D))
+      noteTopLevelContainer(Container);
+    if (!isa<ObjCImplDecl>(D) && !isa<FunctionDecl>(D))
+      continue;
+    if (LookupCachesStale)
+      invalidateLookupCaches();
+    startBudgetClock();
+    Dispatcher->TraverseDecl(D);
+    stopBudgetClock();
+    StreamedDecls.insert(D);
+    ++Stats.DeclsStreamed;
+  }
+  DeferInvalidKeys = false;
+  return true;
+}
+
+
+// New keys may change lookups made so far. Caches are dropped before the next
+// validation, so a run of categories costs one rebuild. An @implementation
+// only adds private keys to its own class and subclasses, whose tables are
+// usually first built while validating that @implementation.
+void KeyPathValidationConsumer::noteTopLevelContainer(const ObjCContainerDecl *Container) {
+  if (const ObjCInterfaceDecl *Interface = dyn_cast<ObjCInterfaceDecl>(Container)) {
+    if (!Interface->isThisDeclarationADefinition())
+      return;
+  } else if (const ObjCProtocolDecl *Protocol = dyn_cast<ObjCProtocolDecl>(Container)) {
+    if (!Protocol->isThisDeclarationADefinition())
+      return;
+  } else if (const ObjCImplDecl *Impl = dyn_cast<ObjCImplDecl>(Container)) {
+    const ObjCInterfaceDecl *Interface = Impl->getClassInterface();
+    bool Built = false;
+    for (llvm::DenseMap<const ObjCContainerDecl *, KVCAccessorTable *>::const_iterator T = AccessorTables.begin(), TE = AccessorTables.end();
+        Interface && T != TE && !Built; ++T)
+      if (const ObjCInterfaceDecl *Tabled = dyn_cast<ObjCInterfaceDecl>(T->first))
+        Built = Interface->isSuperClassOf(Tabled);
+    if (!Built)
+      return;
+  }
+  LookupCachesStale = true;
+}
+
+
+void KeyPathValidationConsumer::HandleTranslationUnit(ASTContext &Context) {
+  // A summary for a precompiled header is wanted regardless
+  if (!ValidationStarted && Options.SummaryOutPath.empty() && !mayNeedValidation()) {
+    ++Stats.TranslationUnitsSkipped;
+    startTiming();
+    openFindings();
+    finishOutputs();
+    return;
+  }
+
+  beginValidation();
+  startBudgetClock();
+
+  TranslationUnitDecl *TUD = Context.getTranslationUnitDecl();
+  if (!Options.Streaming)
+    Dispatcher->TraverseDecl(TUD);
+  else {
+    // Everything is declared now; validate what wasn't streamed, then what
+    // was held back.
+    if (LookupCachesStale)
+      invalidateLookupCaches();
+    for (DeclContext::decl_iterator I = TUD->decls_begin(), E = TUD->decls_end(); I != E; ++I)
+      if (!StreamedDecls.count(*I))
+        Dispatcher->TraverseDecl(*I);
+    Dispatcher->replayDeferredVisits();
+  }
+  resolvePendingKeyPaths();
+  stopBudgetClock();
+
+  if (!Options.SummaryOutPath.empty())
+    writeSummary();
+  finishOutputs();
+}
+
+
+// Empty ones too, for a translation unit that was skipped, so build systems
+// find every file they expect.
+void KeyPathValidationConsumer::finishOutputs() {
+  if (Options.WriteKVOGraph)
+    writeKVOGraph();
+  if (Options.WriteManifest)
+    writeManifest();
+
+  // Here rather than in the destructor, which clang may skip (-disable-free)
+  if (Findings && !Findings->finish()) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write key path findings '%0'")) << Options.FindingsPath;
+  }
+  Findings.reset();
+
+  reportStats();
+}
+
+
+KeyPathValidationConsumer *KeyPathValidationConsumer::create(const CompilerInstance &Compiler, const KeyPathValidationOptions &Options) {
+  KeyPathValidationConsumer *Consumer = new KeyPathValidationConsumer(Compiler, Options);
+  std::string Error;
+  if (!Options.SelectorsPath.empty() && !Consumer->getSelectorRegistry().loadFile(Options.SelectorsPath, Error)) {
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Error, "invalid key path selectors: %0")) << Error;
+  }
 
-  ValueForKeyVisitor(this, Compiler).TraverseDecl(Context.getTranslationUnitDecl());
-  KeyPathsAffectingVisitor(this, Compiler).TraverseDecl(Context.getTranslationUnitDecl());
-  FBBinderVisitor(this, Compiler).TraverseDecl(Context.getTranslationUnitDecl());
+  Consumer->addCheck(new KeyPathArgumentVisitor(Consumer, Consumer->getSelectorRegistry()));
+  Consumer->addCheck(new KeyPathsAffectingVisitor(Consumer, Compiler));
+  return Consumer;
+}
+
+
+void KeyPathValidationConsumer::validateDecl(Decl *D, std::vector<KeyPathFinding> &Out) {
+  validateDecls(D, Out);
+}
+
+
+static bool overlaps(const SourceManager &SM, const Decl *D, SourceRange Range) {
+  SourceRange DeclRange = D->getSourceRange();
+  return !SM.isBeforeInTranslationUnit(DeclRange.getEnd(), Range.getBegin()) &&
+         !SM.isBeforeInTranslationUnit(Range.getEnd(), DeclRange.getBegin());
+}
+
+
+// Methods are looked at one by one, so that an edit inside a large
+// @implementation doesn't re-check the rest of it.
+void KeyPathValidationConsumer::validateRange(SourceRange Range, std::vector<KeyPathFinding> &Out) {
+  const SourceManager &SM = Context.getSourceManager();
+  SmallVector<Decl *, 8> Overlapping;
+  TranslationUnitDecl *TUD = Context.getTranslationUnitDecl();
+  for (DeclContext::decl_iterator I = TUD->decls_begin(), E = TUD->decls_end(); I != E; ++I) {
+    Decl *D = *I;
+    if (D->isFromASTFile())
+      continue;
+    if (ObjCImplDecl *Impl = dyn_cast<ObjCImplDecl>(D)) {
+      for (DeclContext::decl_iterator Member = Impl->decls_begin(), MemberEnd = Impl->decls_end(); Member != MemberEnd; ++Member)
+        if (overlaps(SM, *Member, Range))
+          Overlapping.push_back(*Member);
+    } else if (overlaps(SM, D, Range))
+      Overlapping.push_back(D);
+  }
+  validateDecls(Overlapping, Out);
+}
+
+
+void KeyPathValidationConsumer::validateDecls(ArrayRef<Decl *> Decls, std::vector<KeyPathFinding> &Out) {
+  beginValidation();
+  if (LookupCachesStale)
+    invalidateLookupCaches();
+
+  Collected = &Out;
+  CostReported.clear();
+  for (ArrayRef<Decl *>::iterator D = Decls.begin(), DEnd = Decls.end(); D != DEnd; ++D)
+    Dispatcher->TraverseDecl(*D);
+  resolvePendingKeyPaths();
+  Collected = NULL;
+}
+
+
+void KeyPathValidationConsumer::startTiming() {
+  bool TimeReport = Compiler.getFrontendOpts().ShowTimers;
+  if (!Options.PrintStats && !TimeReport)
+    return;
+
+  if (TimeReport)
+    TimeReportGroup.reset(new llvm::TimerGroup("Key path validation"));
+  CheckTimers.reset(new StatsTimer[Checks.size()]);
+  for (size_t I = 0, E = Checks.size(); I != E; ++I)
+    CheckTimers[I].init(Checks[I]->getName(), TimeReportGroup.get());
+  KeyLookupTimer.reset(new StatsTimer);
+  KeyLookupTimer->init("key-lookup", TimeReportGroup.get());
+}
+
+
+void KeyPathValidationConsumer::startBudgetClock() {
+  if (Options.BudgetMs)
+    BudgetClockStart = llvm::sys::TimeValue::now();
+}
+
+
+void KeyPathValidationConsumer::stopBudgetClock() {
+  if (Options.BudgetMs)
+    BudgetTimeSpent += llvm::sys::TimeValue::now() - BudgetClockStart;
+}
+
+
+// Generated sources can have so many key paths that checking them all takes
+// longer than compiling the rest. Once the budget runs out, the rest of the
+// TU is checked more cheaply, or not at all, and a warning at the key path
+// where that happened says so. Clang 3.4 has no remarks, and the warning
+// isn't made an error by -Werror. Hosts checking a method at a time, through
+// validateDecl and validateRange, have no budget.
+KeyPathValidationConsumer::BudgetState KeyPathValidationConsumer::chargeBudget(const Expr *KeyPathExpr) {
+  if (Collected)
+    return BS_Within;
+  if (Replaying)
+    return ReplayBudget;
+
+  if (Budget == BS_Within) {
+    bool OverKeyPaths = Options.BudgetKeyPaths && Stats.KeyPathsValidated >= Options.BudgetKeyPaths;
+    bool OverTime = false;
+    if (!OverKeyPaths && Options.BudgetMs) {
+      llvm::sys::TimeValue Spent = BudgetTimeSpent + (llvm::sys::TimeValue::now() - BudgetClockStart);
+      OverTime = Spent.msec() >= Options.BudgetMs;
+    }
+    if (!OverKeyPaths && !OverTime)
+      return BS_Within;
+
+    Budget = Options.BudgetStop ? BS_Stopped : BS_Degraded;
+    std::string Limit = OverKeyPaths ? llvm::utostr(Options.BudgetKeyPaths) + " key paths" : llvm::utostr(Options.BudgetMs) + " ms";
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(KeyPathExpr->getLocStart(), D.getCustomDiagID(DiagnosticsEngine::Warning,
+        "key path validation budget of %0 used up; %select{only the first key of each key path|no key path}1 is checked from here on"))
+      << Limit << unsigned(Options.BudgetStop);
+  }
+  ++Stats.KeyPathsOverBudget;
+  return Budget;
+}
+
+
+void KeyPathValidationConsumer::reportStats() {
+  if (!Options.PrintStats)
+    return;
+  if (Options.StatsPath.empty()) {
+    Stats.print(llvm::errs());
+    return;
+  }
+
+  SmallVector<const StatsTimer *, 4> Timers;
+  for (size_t I = 0, E = Checks.size(); I != E; ++I)
+    Timers.push_back(&CheckTimers[I]);
+  Timers.push_back(KeyLookupTimer.get());
+
+  std::string Error;
+  llvm::raw_fd_ostream OS(Options.StatsPath.c_str(), Error, llvm::sys::fs::F_None);
+  if (Error.empty()) {
+    const SourceManager &SM = Context.getSourceManager();
+    const FileEntry *MainFile = SM.getFileEntryForID(SM.getMainFileID());
+    Stats.printJSON(OS, MainFile ? MainFile->getName() : "", Timers);
+  }
+  if (!Error.empty() || OS.has_error()) {
+    OS.clear_error();
+    DiagnosticsEngine &D = Compiler.getDiagnostics();
+    D.Report(D.getCustomDiagID(DiagnosticsEngine::Warning, "can't write key path validation stats '%0'")) << Options.StatsPath;
+  }
 }
 
 
@@ -34,18 +339,114 @@ public:
 };
 
 
+// Usable both as the main action (-plugin, with -fsyntax-only) and added to a
+// regular compile (-add-plugin), where the consumer runs after code generation
+// on the same AST and reports through the same DiagnosticsEngine.
 class ValidateKeyPathsAction : public PluginASTAction {
+  KeyPathValidationOptions Options;
+
 protected:
   ASTConsumer *CreateASTConsumer(CompilerInstance &compiler, llvm::StringRef) {
     LangOptions const opts = compiler.getLangOpts();
-    if (opts.ObjC1 || opts.ObjC2)
-      return new KeyPathValidationConsumer(compiler);
-    else
+    if (opts.ObjC1 || opts.ObjC2) {
+      // Summaries live next to the PCH they describe...
+      KeyPathValidationOptions ConsumerOptions = Options;
+      const FrontendOptions &FrontendOpts = compiler.getFrontendOpts();
+      if (ConsumerOptions.SummaryOutPath.empty() && FrontendOpts.ProgramAction == frontend::GeneratePCH &&
+          !FrontendOpts.OutputFile.empty() && FrontendOpts.OutputFile != "-")
+        ConsumerOptions.SummaryOutPath = FrontendOpts.OutputFile + ".kvcsummary";
+      const std::string &PCHInclude = compiler.getPreprocessorOpts().ImplicitPCHInclude;
+      if (ConsumerOptions.SummaryInPath.empty() && !PCHInclude.empty())
+        ConsumerOptions.SummaryInPath = PCHInclude + ".kvcsummary";
+      // As are stats, with the object file
+      if (ConsumerOptions.PrintStats && ConsumerOptions.StatsPath.empty() &&
+          !FrontendOpts.OutputFile.empty() && FrontendOpts.OutputFile != "-")
+        ConsumerOptions.StatsPath = FrontendOpts.OutputFile + ".kpvstats.json";
+      // And findings and the KVO graph, unless they can only go to stdout
+      if (ConsumerOptions.WriteFindings && ConsumerOptions.FindingsPath.empty()) {
+        if (!FrontendOpts.OutputFile.empty() && FrontendOpts.OutputFile != "-")
+          ConsumerOptions.FindingsPath = FrontendOpts.OutputFile + (ConsumerOptions.FindingsAsSARIF ? ".kpvfindings.sarif" : ".kpvfindings.jsonl");
+        else
+          ConsumerOptions.FindingsPath = "-";
+      }
+      if (ConsumerOptions.WriteKVOGraph && ConsumerOptions.KVOGraphPath.empty()) {
+        if (!FrontendOpts.OutputFile.empty() && FrontendOpts.OutputFile != "-")
+          ConsumerOptions.KVOGraphPath = FrontendOpts.OutputFile + ".kvograph.json";
+        else
+          ConsumerOptions.KVOGraphPath = "-";
+      }
+      // A binary manifest never goes to stdout
+      if (ConsumerOptions.WriteManifest && ConsumerOptions.ManifestPath.empty() &&
+          !FrontendOpts.OutputFile.empty() && FrontendOpts.OutputFile != "-")
+        ConsumerOptions.ManifestPath = FrontendOpts.OutputFile + ".kpvmanifest";
+
+      return KeyPathValidationConsumer::create(compiler, ConsumerOptions);
+    } else
       return new NullConsumer();
   }
 
   bool ParseArgs(const CompilerInstance &compiler,
                  const std::vector<std::string>& args) {
+    for (std::vector<std::string>::const_iterator Arg = args.begin(), ArgEnd = args.end();
+        Arg != ArgEnd; ++Arg) {
+      StringRef Name, Value;
+      llvm::tie(Name, Value) = StringRef(*Arg).split('=');
+      unsigned Threads, Budget;
+
+      if (Name == "system-headers" && Value.empty())
+        Options.SkipSystemHeaders = false;
+      else if (Name == "allow-path" && !Value.empty())
+        Options.AllowPathPrefixes.push_back(Value.str());
+      else if (Name == "deny-path" && !Value.empty())
+        Options.DenyPathPrefixes.push_back(Value.str());
+      else if (Name == "header-stamps" && !Value.empty())
+        Options.HeaderStampDir = Value.str();
+      else if (Name == "summary-in" && !Value.empty())
+        Options.SummaryInPath = Value.str();
+      else if (Name == "summary-out" && !Value.empty())
+        Options.SummaryOutPath = Value.str();
+      else if (Name == "changed-lines" && !Value.empty())
+        Options.ChangedLinesPath = Value.str();
+      else if (Name == "result-cache" && !Value.empty())
+        Options.ResultCacheDir = Value.str();
+      else if (Name == "streaming" && Value.empty())
+        Options.Streaming = true;
+      else if (Name == "parallel" && !Value.getAsInteger(10, Threads) && Threads > 0)
+        Options.ResolverThreads = Threads;
+      else if (Name == "selectors" && !Value.empty())
+        Options.SelectorsPath = Value.str();
+      else if (Name == "findings") {
+        Options.WriteFindings = true;
+        Options.FindingsPath = Value.str();
+      }
+      else if (Name == "findings-format" && (Value == "jsonl" || Value == "sarif"))
+        Options.FindingsAsSARIF = Value == "sarif";
+      else if (Name == "kvo-graph") {
+        Options.WriteKVOGraph = true;
+        Options.KVOGraphPath = Value.str();
+      }
+      else if (Name == "perf" && Value.empty())
+        Options.PerfWarnings = true;
+      else if (Name == "manifest") {
+        Options.WriteManifest = true;
+        Options.ManifestPath = Value.str();
+      }
+      else if (Name == "budget-ms" && !Value.getAsInteger(10, Budget) && Budget > 0)
+        Options.BudgetMs = Budget;
+      else if (Name == "budget-keys" && !Value.getAsInteger(10, Budget) && Budget > 0)
+        Options.BudgetKeyPaths = Budget;
+      else if (Name == "budget-mode" && (Value == "degrade" || Value == "stop"))
+        Options.BudgetStop = Value == "stop";
+      else if (Name == "stats") {
+        Options.PrintStats = true;
+        Options.StatsPath = Value.str();
+      }
+      else {
+        DiagnosticsEngine &D = compiler.getDiagnostics();
+        D.Report(D.getCustomDiagID(DiagnosticsEngine::Error, "invalid argument '%0' to validate-key-paths")) << *Arg;
+        return false;
+      }
+    }
     return true;
   }
 };
@@ -0,0 +1,111 @@
+//
+// WorkStealingPool.h
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+
+#ifndef CLANG_KPV_WORK_STEALING_POOL_H
+#define CLANG_KPV_WORK_STEALING_POOL_H
+
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/Support/Mutex.h"
+#include <deque>
+#include <pthread.h>
+#include <vector>
+
+
+// Runs jobs 0..Count-1 on NumThreads threads (the calling thread included) and
+// returns when all have finished. Jobs are dealt out round-robin to per-thread
+// queues; a thread whose queue runs dry steals from the back of another's, so
+// a few slow jobs don't leave the other threads idle.
+class WorkStealingPool {
+public:
+  typedef void (*JobFn)(void *Context, unsigned Index);
+
+  static void run(unsigned Count, unsigned NumThreads, JobFn Job, void *Context) {
+    if (NumThreads > Count)
+      NumThreads = Count;
+    if (NumThreads <= 1) {
+      for (unsigned Index = 0; Index < Count; ++Index)
+        Job(Context, Index);
+      return;
+    }
+
+    WorkStealingPool Pool(NumThreads, Job, Context);
+    for (unsigned Index = 0; Index < Count; ++Index)
+      Pool.Queues[Index % NumThreads].Jobs.push_back(Index);
+
+    std::vector<Worker> Workers(NumThreads);
+    std::vector<pthread_t> Threads(NumThreads);
+    std::vector<bool> Started(NumThreads, false);
+    for (unsigned Self = 0; Self < NumThreads; ++Self) {
+      Workers[Self].Pool = &Pool;
+      Workers[Self].Self = Self;
+    }
+    for (unsigned Self = 1; Self < NumThreads; ++Self)
+      Started[Self] = pthread_create(&Threads[Self], NULL, &workerMain, &Workers[Self]) == 0;
+
+    // Threads that couldn't be started leave their jobs to be stolen
+    workerMain(&Workers[0]);
+    for (unsigned Self = 1; Self < NumThreads; ++Self)
+      if (Started[Self])
+        pthread_join(Threads[Self], NULL);
+  }
+
+private:
+  struct Queue {
+    llvm::sys::Mutex Lock;
+    std::deque<unsigned> Jobs;
+  };
+
+  struct Worker {
+    WorkStealingPool *Pool;
+    unsigned Self;
+  };
+
+  llvm::OwningArrayPtr<Queue> Queues;
+  unsigned NumQueues;
+  JobFn Job;
+  void *Context;
+
+  WorkStealingPool(unsigned NumThreads, JobFn Job, void *Context)
+    : Queues(new Queue[NumThreads])
+    , NumQueues(NumThreads)
+    , Job(Job)
+    , Context(Context)
+  { }
+
+  bool takeJob(unsigned Self, unsigned &Index) {
+    {
+      Queue &Own = Queues[Self];
+      llvm::sys::ScopedLock Guard(Own.Lock);
+      if (!Own.Jobs.empty()) {
+        Index = Own.Jobs.front();
+        Own.Jobs.pop_front();
+        return true;
+      }
+    }
+
+    for (unsigned Offset = 1; Offset < NumQueues; ++Offset) {
+      Queue &Victim = Queues[(Self + Offset) % NumQueues];
+      llvm::sys::ScopedLock Guard(Victim.Lock);
+      if (!Victim.Jobs.empty()) {
+        Index = Victim.Jobs.back();
+        Victim.Jobs.pop_back();
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static void *workerMain(void *Arg) {
+    Worker *W = static_cast<Worker *>(Arg);
+    unsigned Index;
+    while (W->Pool->takeJob(W->Self, Index))
+      W->Pool->Job(W->Pool->Context, Index);
+    return NULL;
+  }
+};
+
+#endif
@@ -0,0 +1,266 @@
+#!/usr/bin/env python
+#
+# gen_corpus.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Generates a synthetic Objective-C corpus for benchmarking the plug-in: a
+# stub Foundation, a hierarchy of model classes with categories and
+# protocols, and translation units full of key path sites. Output depends
+# only on the parameters (and seed), so numbers from different plug-in
+# versions are comparable.
+#
+
+import argparse
+import json
+import os
+import random
+
+
+FOUNDATION_H = """\
+// Minimal Foundation stand-in, so the corpus doesn't depend on an SDK
+@class NSString;
+
+@protocol NSObject
+- (id)self;
+@end
+
+@interface NSObject <NSObject>
++ (instancetype)alloc;
+- (instancetype)init;
+- (id)valueForKey:(NSString *)key;
+- (id)valueForKeyPath:(NSString *)keyPath;
+@end
+
+@interface NSString : NSObject
+@property (readonly) unsigned long length;
+@end
+
+@interface NSNumber : NSObject
++ (NSNumber *)numberWithInt:(int)value;
++ (NSNumber *)numberWithDouble:(double)value;
++ (NSNumber *)numberWithBool:(signed char)value;
+@property (readonly) int intValue;
+@end
+
+@interface NSArray : NSObject
+@property (readonly) unsigned long count;
+@end
+
+@interface NSSet : NSObject
++ (instancetype)setWithObjects:(id)firstObject, ...;
+@property (readonly) unsigned long count;
+@end
+
+@interface NSOrderedSet : NSObject
+@property (readonly) unsigned long count;
+@end
+
+@interface NSDictionary : NSObject
+@property (readonly) unsigned long count;
+@end
+"""
+
+BINDER_H = """\
+#import "Foundation.h"
+
+@interface FBBinder : NSObject
+- (void)bindToModel:(id)model keyPath:(NSString *)keyPath change:(id)change;
+- (void)bindToModels:(NSArray *)models keyPaths:(NSArray *)keyPaths change:(id)change;
+@end
+"""
+
+
+class Model(object):
+    def __init__(self, name, superclass, protocols):
+        self.name = name
+        self.superclass = superclass
+        self.protocols = protocols
+        # (key, type name or None for a scalar)
+        self.properties = []
+        self.category_properties = []
+
+    def own_keys(self):
+        return self.properties + self.category_properties
+
+
+class Corpus(object):
+    def __init__(self, args):
+        self.args = args
+        self.random = random.Random(args.seed)
+        self.protocols = []
+        self.models = []
+        self.expected_invalid = 0
+
+    def build(self):
+        a = self.args
+        for p in range(a.protocols):
+            keys = [('protocolKey%d_%d' % (p, k), None) for k in range(a.protocol_keys)]
+            self.protocols.append(('BenchProtocol%d' % p, keys))
+
+        # Hierarchies are chains of `depth` classes, each rooted at NSObject
+        for c in range(a.classes):
+            depth = c % a.depth
+            superclass = self.models[c - 1] if depth > 0 else None
+            protocols = [self.protocols[(c + i) % len(self.protocols)][0]
+                         for i in range(min(a.protocol_fanout, len(self.protocols)))]
+            self.models.append(Model('BenchModel%d' % c, superclass, protocols))
+
+        # Relationships point at any class, so paths wander across hierarchies
+        for c, model in enumerate(self.models):
+            for k in range(a.keys):
+                if k % 3 == 0:
+                    model.properties.append(('count%d_%d' % (c, k), None))
+                else:
+                    target = self.models[self.random.randrange(len(self.models))].name
+                    model.properties.append(('rel%d_%d' % (c, k), target))
+            for cat in range(a.categories):
+                target = self.models[self.random.randrange(len(self.models))].name
+                model.category_properties.append(('cat%d_%d' % (c, cat), target))
+
+    def all_keys(self, model):
+        keys = []
+        m = model
+        while m is not None:
+            keys.extend(m.own_keys())
+            m = m.superclass
+        for proto in model.protocols:
+            for name, keys_ in self.protocols:
+                if name == proto:
+                    keys.extend(keys_)
+        return keys
+
+    def model_named(self, name):
+        return self.models[int(name[len('BenchModel'):])]
+
+    def key_path(self, model):
+        """Returns a key path of up to --path-length keys starting at model,
+        invalid in its last key for roughly --invalid-percent of sites."""
+        keys = []
+        current = model
+        for _ in range(self.args.path_length):
+            key, target = self.random.choice(self.all_keys(current))
+            keys.append(key)
+            if target is None:
+                break
+            current = self.model_named(target)
+        if self.random.randrange(100) < self.args.invalid_percent:
+            keys[-1] = keys[-1] + 'Typo'
+            self.expected_invalid += 1
+        return '.'.join(keys)
+
+    def write(self, out_dir):
+        if not os.path.isdir(out_dir):
+            os.makedirs(out_dir)
+        self._write(out_dir, 'Foundation.h', FOUNDATION_H)
+        self._write(out_dir, 'FBBinder.h', BINDER_H)
+        self._write(out_dir, 'Models.h', self._models_header())
+
+        sources = []
+        sites_per_file = max(1, self.args.sites // self.args.files)
+        binds_per_file = self.args.bind_sites // self.args.files
+        for f in range(self.args.files):
+            name = 'Sites%d.m' % f
+            self._write(out_dir, name, self._sites_file(f, sites_per_file, binds_per_file))
+            sources.append(name)
+
+        manifest = {
+            'parameters': vars(self.args),
+            'sources': sources,
+            'expected_diagnostics': self.expected_invalid,
+        }
+        self._write(out_dir, 'corpus.json', json.dumps(manifest, indent=2, sort_keys=True) + '\n')
+
+    def _models_header(self):
+        lines = ['#import "Foundation.h"', '']
+        for model in self.models:
+            lines.append('@class %s;' % model.name)
+        lines.append('')
+        for name, keys in self.protocols:
+            lines.append('@protocol %s <NSObject>' % name)
+            for key, _ in keys:
+                lines.append('@property (nonatomic) int %s;' % key)
+            lines.append('@end')
+            lines.append('')
+        for model in self.models:
+            superclass = model.superclass.name if model.superclass else 'NSObject'
+            protocols = ' <%s>' % ', '.join(model.protocols) if model.protocols else ''
+            lines.append('@interface %s : %s%s' % (model.name, superclass, protocols))
+            for key, target in model.properties:
+                lines.append(self._property(key, target))
+            lines.append('@end')
+            lines.append('')
+            for cat, (key, target) in enumerate(model.category_properties):
+                lines.append('@interface %s (Bench%d)' % (model.name, cat))
+                lines.append(self._property(key, target))
+                lines.append('@end')
+                lines.append('')
+        return '\n'.join(lines)
+
+    def _property(self, key, target):
+        if target is None:
+            return '@property (nonatomic) int %s;' % key
+        return '@property (nonatomic, strong) %s *%s;' % (target, key)
+
+    def _sites_file(self, index, sites, binds):
+        lines = ['#import "Models.h"', '#import "FBBinder.h"', '']
+        for s in range(sites):
+            model = self.models[self.random.randrange(len(self.models))]
+            lines.append('id site%d_%d(%s *model) {' % (index, s, model.name))
+            lines.append('  return [model valueForKeyPath:@"%s"];' % self.key_path(model))
+            lines.append('}')
+        lines.append('')
+        lines.append('void binds%d(FBBinder *binder) {' % index)
+        for b in range(binds):
+            models = [self.models[self.random.randrange(len(self.models))] for _ in range(2)]
+            lines.append('  {')
+            for i, model in enumerate(models):
+                lines.append('    %s *model%d = [[%s alloc] init];' % (model.name, i, model.name))
+            paths = ['@[@"%s"]' % self.key_path(model) for model in models]
+            lines.append('    [binder bindToModels:@[model0, model1] keyPaths:@[%s] change:nil];' % ', '.join(paths))
+            lines.append('  }')
+        lines.append('}')
+        lines.append('')
+        return '\n'.join(lines)
+
+    def _write(self, out_dir, name, contents):
+        with open(os.path.join(out_dir, name), 'w') as f:
+            f.write(contents)
+
+
+def add_corpus_arguments(parser):
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--classes', type=int, default=200, help='model classes')
+    parser.add_argument('--depth', type=int, default=4, help='length of each inheritance chain')
+    parser.add_argument('--keys', type=int, default=6, help='properties per class')
+    parser.add_argument('--categories', type=int, default=2, help='categories per class, each adding a property')
+    parser.add_argument('--protocols', type=int, default=8, help='protocols, shared between classes')
+    parser.add_argument('--protocol-keys', type=int, default=2, help='properties per protocol')
+    parser.add_argument('--protocol-fanout', type=int, default=2, help='protocols adopted by each class')
+    parser.add_argument('--path-length', type=int, default=3, help='maximum keys per key path')
+    parser.add_argument('--sites', type=int, default=2000, help='valueForKeyPath: sites in total')
+    parser.add_argument('--bind-sites', type=int, default=200, help='bindToModels:keyPaths:change: sites in total')
+    parser.add_argument('--invalid-percent', type=int, default=5, help='percentage of key paths made invalid')
+    parser.add_argument('--files', type=int, default=4, help='translation units to spread sites over')
+
+
+def generate(args, out_dir):
+    corpus = Corpus(args)
+    corpus.build()
+    corpus.write(out_dir)
+    return corpus
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Generate a synthetic Objective-C corpus for benchmarking validate-key-paths.')
+    add_corpus_arguments(parser)
+    parser.add_argument('out_dir')
+    args = parser.parse_args()
+    out_dir = args.out_dir
+    del args.out_dir
+    generate(args, out_dir)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,134 @@
+#!/usr/bin/env python
+#
+# run_bench.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Measures what the plug-in adds to -fsyntax-only over generated corpora
+# (see gen_corpus.py). Each translation unit is compiled --repeat times with
+# and without the plug-in, interleaved, and the fastest run of each is kept,
+# which is much steadier than the mean on a busy machine. The plug-in's own
+# counters come from one further run with stats, kept separate so timing
+# isn't measured with timers running.
+#
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import time
+
+import gen_corpus
+
+
+# Each preset stresses one dimension; the rest stay at gen_corpus defaults
+PRESETS = [
+    ('baseline', {}),
+    ('deep-hierarchy', {'classes': 200, 'depth': 40}),
+    ('many-categories', {'categories': 20}),
+    ('protocol-fanout', {'protocols': 64, 'protocol_keys': 4, 'protocol_fanout': 16}),
+    ('long-paths', {'path_length': 8}),
+    ('many-sites', {'sites': 20000, 'bind_sites': 2000, 'files': 8}),
+    ('many-classes', {'classes': 3000, 'sites': 4000}),
+]
+
+
+def corpus_arguments(overrides, seed):
+    parser = argparse.ArgumentParser()
+    gen_corpus.add_corpus_arguments(parser)
+    args = parser.parse_args(['--seed', str(seed)])
+    for key, value in overrides.items():
+        setattr(args, key, value)
+    return args
+
+
+def compile_command(options, corpus_dir, source, plugin_args=None):
+    command = [options.clang, '-fsyntax-only', '-fobjc-arc', '-I', corpus_dir, os.path.join(corpus_dir, source)]
+    if plugin_args is not None:
+        command[1:1] = ['-Xclang', '-load', '-Xclang', options.plugin,
+                        '-Xclang', '-add-plugin', '-Xclang', 'validate-key-paths']
+        for arg in plugin_args:
+            command[1:1] = ['-Xclang', '-plugin-arg-validate-key-paths', '-Xclang', arg]
+    return command
+
+
+def run(command):
+    start = time.time()
+    process = subprocess.Popen(command, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    _, stderr = process.communicate()
+    elapsed = time.time() - start
+    if process.returncode != 0:
+        sys.stderr.write(stderr.decode('utf-8', 'replace'))
+        raise SystemExit('error: %s failed' % ' '.join(command))
+    return elapsed
+
+
+def bench_preset(options, name, overrides):
+    corpus_dir = os.path.join(options.work_dir, name)
+    gen_corpus.generate(corpus_arguments(overrides, options.seed), corpus_dir)
+    with open(os.path.join(corpus_dir, 'corpus.json')) as f:
+        manifest = json.load(f)
+
+    baseline = plugin = 0.0
+    counters = {}
+    for source in manifest['sources']:
+        baseline_runs, plugin_runs = [], []
+        for _ in range(options.repeat):
+            baseline_runs.append(run(compile_command(options, corpus_dir, source)))
+            plugin_runs.append(run(compile_command(options, corpus_dir, source, [])))
+        baseline += min(baseline_runs)
+        plugin += min(plugin_runs)
+
+        stats_path = os.path.join(corpus_dir, source + '.kpvstats.json')
+        run(compile_command(options, corpus_dir, source, ['stats=' + stats_path]))
+        with open(stats_path) as f:
+            stats = json.load(f)
+        for key, value in stats.items():
+            if isinstance(value, int):
+                counters[key] = counters.get(key, 0) + value
+
+    return {
+        'parameters': manifest['parameters'],
+        'translation_units': len(manifest['sources']),
+        'baseline_seconds': round(baseline, 4),
+        'plugin_seconds': round(plugin, 4),
+        'overhead_seconds': round(plugin - baseline, 4),
+        'overhead_percent': round(100.0 * (plugin - baseline) / baseline, 2) if baseline else None,
+        'expected_diagnostics': manifest['expected_diagnostics'],
+        'counters': counters,
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Benchmark validate-key-paths against plain -fsyntax-only.')
+    parser.add_argument('--clang', required=True, help='clang the plug-in was built for')
+    parser.add_argument('--plugin', required=True, help='path to libKeyPathValidator')
+    parser.add_argument('--work-dir', default='bench/out', help='where corpora are generated')
+    parser.add_argument('--preset', action='append', help='run only this preset (may be repeated)')
+    parser.add_argument('--repeat', type=int, default=5, help='runs per translation unit and configuration')
+    parser.add_argument('--seed', type=int, default=1)
+    parser.add_argument('--output', help='write results as JSON here rather than stdout')
+    options = parser.parse_args()
+
+    results = {}
+    for name, overrides in PRESETS:
+        if options.preset and name not in options.preset:
+            continue
+        result = bench_preset(options, name, overrides)
+        results[name] = result
+        sys.stderr.write('%-16s %8.3fs baseline %8.3fs with plug-in  %+6.1f%%  %d/%d diagnostics\n' % (
+            name, result['baseline_seconds'], result['plugin_seconds'], result['overhead_percent'] or 0.0,
+            result['counters'].get('diagnostics_emitted', 0), result['expected_diagnostics']))
+
+    output = json.dumps(results, indent=2, sort_keys=True) + '\n'
+    if options.output:
+        with open(options.output, 'w') as f:
+            f.write(output)
+    else:
+        sys.stdout.write(output)
+
+
+if __name__ == '__main__':
+    main()
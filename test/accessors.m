@@ -0,0 +1,87 @@
+#import <Foundation/Foundation.h>
+
+@class Item;
+
+@interface Accessors : NSObject {
+    NSString *_title;
+    BOOL _isHidden;
+}
+
+- (NSDate *)getTimestamp;
+- (NSURL *)getURL;
+
+// Ordered to-many accessor pattern
+- (NSUInteger)countOfItems;
+- (Item *)objectInItemsAtIndex:(NSUInteger)index;
+
+// Unordered to-many accessor pattern
+- (NSUInteger)countOfTags;
+- (NSEnumerator *)enumeratorOfTags;
+- (NSString *)memberOfTags:(NSString *)tag;
+
+// Incomplete unordered pattern
+- (NSUInteger)countOfOrphans;
+- (NSEnumerator *)enumeratorOfOrphans;
+
+@end
+
+@interface SubAccessors : Accessors
+@end
+
+
+static void testFn(void)
+{
+    Accessors *a;
+    [a valueForKey:@"timestamp"];
+    [a valueForKeyPath:@"timestamp.timeIntervalSinceNow"];
+    [a valueForKey:@"URL"];
+    [a valueForKey:@"title"];
+    [a valueForKeyPath:@"title.length"];
+    [a valueForKey:@"hidden"];
+    [a valueForKeyPath:@"items.anythingIsOk"];
+    [a valueForKeyPath:@"tags.anythingIsOk"];
+    [a valueForKey:@"orphans"]; // warn
+    [a valueForKey:@"backing"]; // warn
+
+    SubAccessors *s;
+    [s valueForKeyPath:@"timestamp.timeIntervalSinceNow"];
+    [s valueForKeyPath:@"items.@count"];
+    [s valueForKeyPath:@"title.doesNotExist"]; // warn
+}
+
+
+@implementation Accessors {
+    NSMutableArray *_backing;
+}
+
+- (NSDate *)getTimestamp
+{ return nil; }
+- (NSURL *)getURL
+{ return nil; }
+
+- (NSUInteger)countOfItems
+{ return 0; }
+- (Item *)objectInItemsAtIndex:(NSUInteger)index
+{ return nil; }
+
+- (NSUInteger)countOfTags
+{ return 0; }
+- (NSEnumerator *)enumeratorOfTags
+{ return nil; }
+- (NSString *)memberOfTags:(NSString *)tag
+{ return nil; }
+
+- (NSUInteger)countOfOrphans
+{ return 0; }
+- (NSEnumerator *)enumeratorOfOrphans
+{ return nil; }
+
++ (NSSet *)keyPathsForValuesAffectingTitle
+{
+    return [NSSet setWithObjects:@"backing", @"backing.@count", @"hidden", nil];
+}
+
+@end
+
+@implementation SubAccessors
+@end
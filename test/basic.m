@@ -35,6 +35,8 @@ static void testFn(void)
     [t valueForKeyPath:@"fireDate.foo.bar"]; // warn
     [t valueForKey:@"fireDate.timeIntervalSinceNow"]; // warn
     [t valueForKey:@"doesNotExist"]; // warn
+    [t valueForKey:@"fireDat"]; // warn, did you mean 'fireDate'
+    [t valueForKeyPath:@"firedate.timeIntervalSinceNow"]; // warn, did you mean 'fireDate'
 
     id idObj = t;
     [idObj valueForKeyPath:@"fireDate.foo.bar"];
@@ -0,0 +1,20 @@
+#import <Foundation/Foundation.h>
+
+// Run with budget-keys=3
+
+@interface Person : NSObject
+@property NSString *name;
+@property Person *manager;
+@end
+
+
+static void testBudget(Person *p)
+{
+    [p valueForKeyPath:@"manager.name"];
+    [p valueForKeyPath:@"manager.doesNotExist"]; // warn
+    [p valueForKey:@"name"];
+    [p valueForKeyPath:@"manager.name"]; // warn, budget of 3 key paths used up
+    [p valueForKeyPath:@"manager.doesNotExist"]; // only 'manager' is checked
+    [p valueForKeyPath:@"doesNotExist.name"]; // warn
+    [p valueForKey:@"doesNotExist"]; // warn
+}
@@ -0,0 +1,51 @@
+#import <Foundation/Foundation.h>
+
+@interface Person : NSObject
+@property NSString *name;
+@property Person *manager;
+@property NSInteger age;
+@end
+
+@interface Department : NSObject
+@property NSArray *employees;
+@property NSSet *projects;
+@property Person *head;
+@end
+
+
+static void testToMany(Department *d)
+{
+    [d valueForKey:@"employees"];
+    [d valueForKeyPath:@"employees"];
+    [d valueForKeyPath:@"employees.name"]; // warn
+    [d valueForKeyPath:@"employees.@count"];
+    [d valueForKeyPath:@"employees.@avg.age"];
+    [d valueForKeyPath:@"projects.name"]; // warn
+    [d valueForKeyPath:@"head.manager.name"];
+    [d.employees valueForKeyPath:@"manager.name"];
+}
+
+
+static void testLoops(NSArray *people, Department *d)
+{
+    for (Person *p in people) {
+        [p valueForKeyPath:@"manager.name"]; // warn, fix-it to p.manager.name
+        [p valueForKey:@"age"]; // warn, no fix-it (scalar)
+        [(id)p valueForKey:@"name"]; // warn, no fix-it (id)
+    }
+    for (Person *p in [d valueForKey:@"employees"]) {
+        (void)p;
+    }
+    for (NSUInteger i = 0; i < [[d valueForKey:@"employees"] count]; i++) { // warn
+        [[people objectAtIndex:i] valueForKey:@"name"]; // warn, no fix-it (id)
+        [d.head valueForKey:@"manager"]; // warn, fix-it to d.head.manager
+    }
+    NSUInteger n = 0;
+    while (n < 3) {
+        [people enumerateObjectsUsingBlock:^(id obj, NSUInteger idx, BOOL *stop) {
+            [d valueForKey:@"head"];
+        }];
+        n++;
+    }
+    [d valueForKey:@"head"];
+}
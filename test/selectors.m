@@ -0,0 +1,42 @@
+#import <Foundation/Foundation.h>
+
+@interface Observable : NSObject
+@property NSString *name;
+@property NSArray *children;
+@end
+
+@interface NSObject (Bindings)
+- (void)bind:(NSString *)binding toObject:(id)observable withKeyPath:(NSString *)keyPath options:(NSDictionary *)options;
+@end
+
+// Declared in test/selectors.txt
+@interface InHouseObserver : NSObject
+- (void)watch:(id)model keyPaths:(NSArray *)keyPaths;
++ (void)watchKey:(NSString *)key;
+@end
+
+
+static void testFn(Observable *o, InHouseObserver *observer)
+{
+    [o setValue:@"x" forKey:@"name"];
+    [o setValue:@"x" forKey:@"nmae"]; // warn
+    [o setValue:@"x" forKeyPath:@"name.length"];
+    [o setValue:@"x" forKeyPath:@"name.lenght"]; // warn
+
+    [o addObserver:observer forKeyPath:@"children" options:0 context:NULL];
+    [o addObserver:observer forKeyPath:@"childern" options:0 context:NULL]; // warn
+    [o removeObserver:observer forKeyPath:@"children"];
+    [o removeObserver:observer forKeyPath:@"childern" context:NULL]; // warn
+
+    [o mutableArrayValueForKey:@"children"];
+    [o mutableArrayValueForKey:@"kids"]; // warn
+    [o willChangeValueForKey:@"name"];
+    [o didChangeValueForKey:@"nmae"]; // warn
+
+    [observer bind:@"value" toObject:o withKeyPath:@"name.length" options:nil];
+    [observer bind:@"value" toObject:o withKeyPath:@"name.size" options:nil]; // warn
+
+    [observer watch:o keyPaths:@[@"name", @"children.@count"]];
+    [observer watch:o keyPaths:@[@"name", @"nmae"]]; // warn
+    [InHouseObserver watchKey:@"notChecked"]; // class messages aren't checked
+}
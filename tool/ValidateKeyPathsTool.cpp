@@ -0,0 +1,742 @@
+//
+// ValidateKeyPathsTool.cpp
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+// Runs the validate-key-paths plug-in over every translation unit in a
+// compile_commands.json, in parallel, and prints the merged diagnostics.
+// The checks themselves are loaded from the plug-in, so the tool and clang
+// -plugin always agree.
+//
+// With -serve, it instead stays running and validates compile commands sent
+// over a Unix domain socket (utils/kpv_client.py sends them), keeping a
+// precompiled preamble of each file's #imports between requests, and the
+// plug-in's KVC summaries of them loaded.
+//
+
+#include "../WorkStealingPool.h"
+#include "clang/Basic/Diagnostic.h"
+#include "clang/Basic/FileManager.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+#include "clang/Frontend/FrontendAction.h"
+#include "clang/Frontend/FrontendActions.h"
+#include "clang/Frontend/FrontendPluginRegistry.h"
+#include "clang/Lex/Lexer.h"
+#include "clang/Lex/PreprocessorOptions.h"
+#include "clang/Tooling/CompilationDatabase.h"
+#include "clang/Tooling/Tooling.h"
+#include "llvm/ADT/OwningPtr.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/ADT/Twine.h"
+#include "llvm/Support/Atomic.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Signals.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace clang;
+using namespace clang::tooling;
+
+
+static llvm::cl::opt<std::string> BuildPath("p", llvm::cl::desc("Build directory containing compile_commands.json"), llvm::cl::init("."));
+static llvm::cl::opt<unsigned> NumThreads("j", llvm::cl::desc("Translation units to validate in parallel (default: number of CPUs)"), llvm::cl::init(0));
+static llvm::cl::opt<std::string> PluginPath("plugin", llvm::cl::desc("KeyPathValidator plug-in to load (default: ../lib next to this tool)"));
+static llvm::cl::list<std::string> PluginArgs("plugin-arg", llvm::cl::desc("Argument for the plug-in, as with -plugin-arg-validate-key-paths"), llvm::cl::ZeroOrMore);
+static llvm::cl::opt<std::string> ServePath("serve", llvm::cl::desc("Validate compile commands sent to this Unix domain socket until told to stop"));
+static llvm::cl::opt<std::string> PreambleDir("preamble-dir", llvm::cl::desc("Where -serve keeps precompiled preambles (default: a new temporary directory)"));
+static llvm::cl::list<std::string> SourcePaths(llvm::cl::Positional, llvm::cl::desc("[<source> ...]"), llvm::cl::ZeroOrMore);
+
+
+namespace {
+
+struct Finding {
+  std::string File;
+  unsigned Line, Column;
+  std::string Text;
+
+  bool operator<(const Finding &Other) const {
+    if (File != Other.File)
+      return File < Other.File;
+    if (Line != Other.Line)
+      return Line < Other.Line;
+    if (Column != Other.Column)
+      return Column < Other.Column;
+    return Text < Other.Text;
+  }
+  bool operator==(const Finding &Other) const {
+    return File == Other.File && Line == Other.Line && Column == Other.Column && Text == Other.Text;
+  }
+};
+
+
+// Renders diagnostics for one translation unit, to be merged once all
+// threads are done.
+class CollectingDiagnosticConsumer : public DiagnosticConsumer {
+  std::vector<Finding> &Findings;
+
+public:
+  CollectingDiagnosticConsumer(std::vector<Finding> &Findings)
+    : Findings(Findings)
+  { }
+
+  virtual void HandleDiagnostic(DiagnosticsEngine::Level Level, const Diagnostic &Info) {
+    DiagnosticConsumer::HandleDiagnostic(Level, Info);
+    if (Level < DiagnosticsEngine::Warning)
+      return;
+
+    Finding F;
+    F.Line = F.Column = 0;
+    if (Info.getLocation().isValid() && Info.hasSourceManager()) {
+      PresumedLoc PLoc = Info.getSourceManager().getPresumedLoc(Info.getLocation());
+      if (PLoc.isValid()) {
+        F.File = PLoc.getFilename();
+        F.Line = PLoc.getLine();
+        F.Column = PLoc.getColumn();
+      }
+    }
+
+    SmallString<128> Message;
+    Info.FormatDiagnostic(Message);
+    F.Text = (Twine(Level >= DiagnosticsEngine::Error ? "error: " : "warning: ") + Message).str();
+    Findings.push_back(F);
+  }
+};
+
+
+// Parses arguments for the plug-in once the CompilerInstance exists, then
+// lets it supply the AST consumer.
+class PluginInvocationAction : public WrapperFrontendAction {
+  PluginASTAction *Plugin;
+  const std::vector<std::string> &Args;
+
+public:
+  PluginInvocationAction(PluginASTAction *Plugin, const std::vector<std::string> &Args)
+    : WrapperFrontendAction(Plugin)
+    , Plugin(Plugin)
+    , Args(Args)
+  { }
+
+protected:
+  virtual bool BeginInvocation(CompilerInstance &CI) {
+    return Plugin->ParseArgs(CI, Args) && WrapperFrontendAction::BeginInvocation(CI);
+  }
+};
+
+
+struct PreambleInput {
+  std::string Path;
+  uint64_t Size;
+  uint64_t ModificationTime;
+};
+
+// The #imports at the top of one source file, precompiled for one compile
+// command. Like libclang's preambles, the main file is parsed from the
+// byte after them, with the PCH standing in for what came before; the PCH
+// is built from the preamble padded with spaces, so the main file must fit
+// in ReservedSize for its source locations to line up.
+struct Preamble {
+  Preamble() : ReservedSize(0), EndsAtStartOfLine(false), Built(false) { }
+
+  std::string Text;
+  unsigned ReservedSize;
+  bool EndsAtStartOfLine;
+  std::string PCHPath;
+  bool Built;
+  // Headers it was built from, to notice when they change
+  std::vector<PreambleInput> Inputs;
+  // Held while the PCH is rebuilt or used
+  llvm::sys::Mutex Lock;
+};
+
+
+// Builds a preamble PCH, with the plug-in added (-add-plugin) so that it
+// writes the KVC summary next to it, and records the headers it read.
+class BuildPreambleAction : public GeneratePCHAction {
+  StringRef MainFile;
+  std::vector<PreambleInput> &Inputs;
+
+public:
+  BuildPreambleAction(StringRef MainFile, std::vector<PreambleInput> &Inputs)
+    : MainFile(MainFile)
+    , Inputs(Inputs)
+  { }
+
+protected:
+  virtual void EndSourceFileAction() {
+    SourceManager &SM = getCompilerInstance().getSourceManager();
+    for (SourceManager::fileinfo_iterator File = SM.fileinfo_begin(), FileEnd = SM.fileinfo_end(); File != FileEnd; ++File) {
+      PreambleInput Input;
+      Input.Path = File->first->getName();
+      llvm::sys::fs::file_status Status;
+      if (Input.Path == MainFile || llvm::sys::fs::status(Input.Path, Status))
+        continue;
+      Input.Size = Status.getSize();
+      Input.ModificationTime = Status.getLastModificationTime().toEpochTime();
+      Inputs.push_back(Input);
+    }
+    GeneratePCHAction::EndSourceFileAction();
+  }
+};
+
+
+// Validates a file whose preamble was precompiled (or without one, if P is
+// NULL). The summary is found next to the PCH as for any other -include-pch.
+class PreambleValidationAction : public PluginInvocationAction {
+  const Preamble *P;
+
+public:
+  PreambleValidationAction(PluginASTAction *Plugin, const std::vector<std::string> &Args, const Preamble *P)
+    : PluginInvocationAction(Plugin, Args)
+    , P(P)
+  { }
+
+protected:
+  virtual bool BeginInvocation(CompilerInstance &CI) {
+    if (P) {
+      PreprocessorOptions &PPOpts = CI.getPreprocessorOpts();
+      PPOpts.ImplicitPCHInclude = P->PCHPath;
+      PPOpts.PrecompiledPreambleBytes = std::make_pair(unsigned(P->Text.size()), P->EndsAtStartOfLine);
+      // Checked against Inputs before each use instead
+      PPOpts.DisablePCHValidation = true;
+    }
+    return PluginInvocationAction::BeginInvocation(CI);
+  }
+};
+
+
+struct ValidationJob {
+  CompileCommand Command;
+  std::vector<Finding> Findings;
+  bool Succeeded;
+};
+
+struct ToolState {
+  const FrontendPluginRegistry::entry *Plugin;
+  std::vector<std::string> PluginArgs;
+  std::vector<ValidationJob> Jobs;
+};
+
+struct ServerState {
+  ToolState &Tool;
+  std::string PreambleDir;
+  // By invocation arguments, which include the main file
+  llvm::sys::Mutex PreamblesLock;
+  llvm::StringMap<Preamble *> Preambles;
+  // Requests being served, and whether one asked the server to stop
+  volatile llvm::sys::cas_flag ActiveRequests;
+  volatile llvm::sys::cas_flag Stopping;
+
+  ServerState(ToolState &Tool)
+    : Tool(Tool)
+    , ActiveRequests(0)
+    , Stopping(0)
+  { }
+  ~ServerState() {
+    llvm::DeleteContainerSeconds(Preambles);
+  }
+};
+
+struct Connection {
+  ServerState *Server;
+  int FD;
+};
+
+}
+
+
+static std::string makeAbsolute(StringRef Directory, StringRef Path) {
+  if (llvm::sys::path::is_absolute(Path))
+    return Path;
+  SmallString<256> Absolute(Directory);
+  llvm::sys::path::append(Absolute, Path);
+  return Absolute.str();
+}
+
+static bool isSourceFile(StringRef Path) {
+  StringRef Extension = llvm::sys::path::extension(Path);
+  return Extension == ".m" || Extension == ".mm" || Extension == ".c" || Extension == ".cc" || Extension == ".cpp";
+}
+
+
+// The working directory is shared by all threads, so rather than changing
+// into each command's directory, relative input and header search paths are
+// resolved against it. Outputs (object, dependency and serialized diagnostic
+// files) are dropped, as only the diagnostics are wanted.
+static std::vector<std::string> makeInvocationArgs(const CompileCommand &Command) {
+  static const char *const PathFlags[] = {
+    "-I", "-F", "-iquote", "-isystem", "-iframework", "-idirafter", "-include", "-include-pch", "-isysroot"
+  };
+  static const char *const OutputFlags[] = {
+    "-o", "-MF", "-MT", "-MQ", "--serialize-diagnostics"
+  };
+
+  const std::vector<std::string> &CommandLine = Command.CommandLine;
+  std::vector<std::string> Args;
+  for (size_t I = 0, E = CommandLine.size(); I != E; ++I) {
+    StringRef Arg = CommandLine[I];
+    if (I == 0) {
+      Args.push_back(Arg);
+      Args.push_back("-fsyntax-only");
+      continue;
+    }
+    if (Arg == "-fsyntax-only" || Arg == "-MD" || Arg == "-MMD")
+      continue;
+    if (std::find(OutputFlags, llvm::array_endof(OutputFlags), Arg) != llvm::array_endof(OutputFlags)) {
+      ++I;
+      continue;
+    }
+
+    bool Handled = false;
+    for (const char *const *Flag = PathFlags; !Handled && Flag != llvm::array_endof(PathFlags); ++Flag) {
+      if (Arg == *Flag && I + 1 < E) {
+        Args.push_back(Arg);
+        Args.push_back(makeAbsolute(Command.Directory, CommandLine[++I]));
+        Handled = true;
+      } else if (Arg.size() > 2 && Arg.startswith(*Flag) && StringRef(*Flag).size() == 2) {
+        Args.push_back(*Flag + makeAbsolute(Command.Directory, Arg.substr(2)));
+        Handled = true;
+      }
+    }
+    if (Handled)
+      continue;
+
+    if (!Arg.startswith("-") && isSourceFile(Arg))
+      Args.push_back(makeAbsolute(Command.Directory, Arg));
+    else
+      Args.push_back(Arg);
+  }
+  return Args;
+}
+
+
+// Sorts and prints findings, once each.
+static void printFindings(std::vector<Finding> &Findings, raw_ostream &OS) {
+  std::sort(Findings.begin(), Findings.end());
+  Findings.erase(std::unique(Findings.begin(), Findings.end()), Findings.end());
+
+  for (std::vector<Finding>::const_iterator F = Findings.begin(), FEnd = Findings.end(); F != FEnd; ++F) {
+    if (!F->File.empty())
+      OS << F->File << ':' << F->Line << ':' << F->Column << ": ";
+    OS << F->Text << '\n';
+  }
+}
+
+
+static void runJob(void *Context, unsigned Index) {
+  ToolState &State = *static_cast<ToolState *>(Context);
+  ValidationJob &Job = State.Jobs[Index];
+
+  CollectingDiagnosticConsumer Diagnostics(Job.Findings);
+  FileManager Files((FileSystemOptions()));
+  ToolInvocation Invocation(makeInvocationArgs(Job.Command), new PluginInvocationAction(State.Plugin->instantiate(), State.PluginArgs), &Files);
+  Invocation.setDiagnosticConsumer(&Diagnostics);
+  Job.Succeeded = Invocation.run();
+}
+
+
+// Header language for precompiling the preamble of a source file.
+static const char *getHeaderLanguage(StringRef Path) {
+  StringRef Extension = llvm::sys::path::extension(Path);
+  if (Extension == ".mm")
+    return "objective-c++-header";
+  if (Extension == ".c")
+    return "c-header";
+  if (Extension == ".cc" || Extension == ".cpp")
+    return "c++-header";
+  return "objective-c-header";
+}
+
+
+static bool isPreambleCurrent(const Preamble &P) {
+  for (std::vector<PreambleInput>::const_iterator Input = P.Inputs.begin(), InputEnd = P.Inputs.end();
+      Input != InputEnd; ++Input) {
+    llvm::sys::fs::file_status Status;
+    if (llvm::sys::fs::status(Input->Path, Status) || Status.getSize() != Input->Size ||
+        Status.getLastModificationTime().toEpochTime() != Input->ModificationTime)
+      return false;
+  }
+  return true;
+}
+
+
+static void buildPreamble(Preamble &P, StringRef Text, bool EndsAtStartOfLine, size_t FileSize,
+    const std::vector<std::string> &Args, size_t MainFileIndex) {
+  // Sized as libclang does, leaving room for the file to grow between saves
+  P.ReservedSize = FileSize < 4096 ? 8191 : 2 * FileSize;
+  P.Text = Text;
+  P.EndsAtStartOfLine = EndsAtStartOfLine;
+  P.Inputs.clear();
+
+  std::string Padded = Text;
+  Padded.resize(P.ReservedSize - 1, ' ');
+  Padded += '\n';
+
+  std::vector<std::string> PCHArgs;
+  for (size_t I = 0, E = Args.size(); I != E; ++I) {
+    if (Args[I] == "-fsyntax-only")
+      continue;
+    if (I == MainFileIndex) {
+      PCHArgs.push_back("-x");
+      PCHArgs.push_back(getHeaderLanguage(Args[I]));
+    }
+    PCHArgs.push_back(Args[I]);
+  }
+  const char *const Extra[] = { "-o", P.PCHPath.c_str(), "-Xclang", "-add-plugin", "-Xclang", "validate-key-paths" };
+  PCHArgs.insert(PCHArgs.end(), Extra, llvm::array_endof(Extra));
+
+  IgnoringDiagConsumer Diagnostics;
+  FileManager Files((FileSystemOptions()));
+  ToolInvocation Invocation(PCHArgs, new BuildPreambleAction(Args[MainFileIndex], P.Inputs), &Files);
+  Invocation.mapVirtualFile(Args[MainFileIndex], Padded);
+  Invocation.setDiagnosticConsumer(&Diagnostics);
+  // An unusable preamble (say, a missing header) is remembered too, so the
+  // next request doesn't try again until the preamble or its inputs change
+  P.Built = Invocation.run();
+}
+
+
+// A request is the number of arguments in the compile command, in decimal,
+// then the working directory and each argument, all NUL-terminated. The
+// count says where the request ends, so the client needn't shut down its
+// side of the connection, and a client that stops sending mid-request times
+// out rather than holding on to its thread. An empty compile command stops
+// the server.
+static bool readRequest(int FD, CompileCommand &Command) {
+  timeval Timeout = { 30, 0 };
+  setsockopt(FD, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+  std::string Request;
+  size_t Fields = 0, ExpectedFields = 0;
+  char Buffer[4096];
+  while (ExpectedFields == 0 || Fields < ExpectedFields) {
+    ssize_t Count = read(FD, Buffer, sizeof(Buffer));
+    if (Count < 0 && errno == EINTR)
+      continue;
+    if (Count <= 0)
+      return false;
+    size_t Scanned = Request.size();
+    Request.append(Buffer, Count);
+    for (size_t I = Scanned, E = Request.size(); I != E; ++I) {
+      if (Request[I] != '\0')
+        continue;
+      if (++Fields == 1) {
+        unsigned Arguments;
+        if (StringRef(Request.data(), I).getAsInteger(10, Arguments))
+          return false;
+        ExpectedFields = Arguments + 2;
+      }
+    }
+  }
+  if (Fields != ExpectedFields || !StringRef(Request).endswith(StringRef("", 1)))
+    return false;
+
+  StringRef Rest = StringRef(Request).drop_back();
+  StringRef Field;
+  llvm::tie(Field, Rest) = Rest.split('\0'); // the count
+  llvm::tie(Field, Rest) = Rest.split('\0');
+  Command.Directory = Field;
+  for (size_t I = 2; I != ExpectedFields; ++I) {
+    llvm::tie(Field, Rest) = Rest.split('\0');
+    Command.CommandLine.push_back(Field);
+  }
+  return true;
+}
+
+
+static void writeAll(int FD, StringRef Data) {
+  while (!Data.empty()) {
+    ssize_t Count = write(FD, Data.data(), Data.size());
+    if (Count < 0 && errno == EINTR)
+      continue;
+    if (Count <= 0)
+      return;
+    Data = Data.drop_front(Count);
+  }
+}
+
+
+// Replies with the findings, in the same form as a batch run, then a line
+// "exit <status>". Returns false to stop serving.
+static bool serveRequest(ServerState &Server, int FD) {
+  CompileCommand Command;
+  std::string Reply;
+  llvm::raw_string_ostream OS(Reply);
+  if (!readRequest(FD, Command)) {
+    OS << "error: malformed request\nexit 1\n";
+    writeAll(FD, OS.str());
+    return true;
+  }
+  if (Command.CommandLine.empty()) {
+    OS << "exit 0\n";
+    writeAll(FD, OS.str());
+    return false;
+  }
+
+  std::vector<std::string> Args = makeInvocationArgs(Command);
+  size_t MainFileIndex = 0;
+  for (size_t I = 1, E = Args.size(); I != E; ++I)
+    if (!StringRef(Args[I]).startswith("-") && isSourceFile(Args[I]))
+      MainFileIndex = I;
+  OwningPtr<llvm::MemoryBuffer> MainFile;
+  if (MainFileIndex == 0) {
+    OS << "error: no source file in compile command\nexit 1\n";
+    writeAll(FD, OS.str());
+    return true;
+  }
+  if (llvm::error_code EC = llvm::MemoryBuffer::getFile(Args[MainFileIndex], MainFile)) {
+    OS << "error: can't read " << Args[MainFileIndex] << ": " << EC.message() << "\nexit 1\n";
+    writeAll(FD, OS.str());
+    return true;
+  }
+
+  // Only the preprocessor directives are looked at, so the language
+  // options don't matter much
+  LangOptions LangOpts;
+  LangOpts.ObjC1 = LangOpts.ObjC2 = 1;
+  std::pair<unsigned, bool> Bounds = Lexer::ComputePreamble(MainFile.get(), LangOpts);
+  StringRef Text = MainFile->getBuffer().substr(0, Bounds.first);
+
+  // Requests for other files go ahead meanwhile; those for this one wait,
+  // as they'd rebuild the PCH out from under it
+  const Preamble *UsePreamble = NULL;
+  OwningPtr<llvm::sys::ScopedLock> PreambleLocked;
+  if (!Text.empty()) {
+    std::string Key;
+    for (std::vector<std::string>::const_iterator Arg = Args.begin(), ArgEnd = Args.end(); Arg != ArgEnd; ++Arg)
+      Key.append(Arg->c_str(), Arg->size() + 1);
+    Preamble *P;
+    {
+      llvm::sys::ScopedLock Locked(Server.PreamblesLock);
+      Preamble *&Entry = Server.Preambles[Key];
+      if (!Entry) {
+        Entry = new Preamble;
+        Entry->PCHPath = (Twine(Server.PreambleDir) + "/preamble-" + Twine(Server.Preambles.size()) + ".pch").str();
+      }
+      P = Entry;
+    }
+    PreambleLocked.reset(new llvm::sys::ScopedLock(P->Lock));
+    if (P->Text != Text || P->EndsAtStartOfLine != Bounds.second || MainFile->getBufferSize() >= P->ReservedSize || !isPreambleCurrent(*P))
+      buildPreamble(*P, Text, Bounds.second, MainFile->getBufferSize(), Args, MainFileIndex);
+    if (P->Built)
+      UsePreamble = P;
+  }
+
+  std::vector<Finding> Findings;
+  CollectingDiagnosticConsumer Diagnostics(Findings);
+  FileManager Files((FileSystemOptions()));
+  ToolInvocation Invocation(Args, new PreambleValidationAction(Server.Tool.Plugin->instantiate(), Server.Tool.PluginArgs, UsePreamble), &Files);
+  // Exactly what the preamble was computed from, even if the file is saved again meanwhile
+  Invocation.mapVirtualFile(Args[MainFileIndex], MainFile->getBuffer());
+  Invocation.setDiagnosticConsumer(&Diagnostics);
+  bool Succeeded = Invocation.run();
+
+  printFindings(Findings, OS);
+  OS << "exit " << (Succeeded ? 0 : 1) << '\n';
+  writeAll(FD, OS.str());
+  return true;
+}
+
+
+static void *serveConnection(void *Context) {
+  OwningPtr<Connection> C(static_cast<Connection *>(Context));
+  ServerState &Server = *C->Server;
+  if (!serveRequest(Server, C->FD) && llvm::sys::CompareAndSwap(&Server.Stopping, 1, 0) == 0) {
+    // Wake the accept loop so it notices
+    sockaddr_un Address;
+    memset(&Address, 0, sizeof(Address));
+    Address.sun_family = AF_UNIX;
+    strcpy(Address.sun_path, ServePath.c_str());
+    int Wake = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (Wake >= 0) {
+      connect(Wake, (sockaddr *)&Address, sizeof(Address));
+      close(Wake);
+    }
+  }
+  close(C->FD);
+  llvm::sys::AtomicDecrement(&Server.ActiveRequests);
+  return NULL;
+}
+
+
+// Each request is served on its own thread, so a build's parallel compiles
+// are validated in parallel. The compiles are still separate, each with its
+// own ASTContext, but the preamble PCHs carry over between them, and so do
+// the plug-in's KVC summaries of them (see KVCSummary::loadShared), with
+// each class's accessors decoded once.
+static int serve(ToolState &Tool) {
+  ServerState Server(Tool);
+  if (!PreambleDir.empty()) {
+    Server.PreambleDir = PreambleDir;
+  } else {
+    SmallString<128> Dir;
+    if (llvm::error_code EC = llvm::sys::fs::createUniqueDirectory("validate-key-paths", Dir)) {
+      llvm::errs() << "error: can't create a directory for preambles: " << EC.message() << "\n";
+      return 1;
+    }
+    Server.PreambleDir = Dir.str();
+  }
+
+  sockaddr_un Address;
+  memset(&Address, 0, sizeof(Address));
+  Address.sun_family = AF_UNIX;
+  if (ServePath.size() >= sizeof(Address.sun_path)) {
+    llvm::errs() << "error: socket path is too long: " << ServePath << "\n";
+    return 1;
+  }
+  strcpy(Address.sun_path, ServePath.c_str());
+
+  int Listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(ServePath.c_str());
+  if (Listener < 0 || bind(Listener, (sockaddr *)&Address, sizeof(Address)) || listen(Listener, 16)) {
+    llvm::errs() << "error: can't listen on " << ServePath << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+  // A client that gives up shouldn't take the server with it
+  signal(SIGPIPE, SIG_IGN);
+  llvm::llvm_start_multithreaded();
+
+  // Parsing recurses deeply; give request threads a main thread's stack
+  pthread_attr_t Attributes;
+  pthread_attr_init(&Attributes);
+  pthread_attr_setdetachstate(&Attributes, PTHREAD_CREATE_DETACHED);
+  pthread_attr_setstacksize(&Attributes, 8 << 20);
+
+  bool Failed = false;
+  while (!Server.Stopping) {
+    int FD = accept(Listener, NULL, NULL);
+    if (FD < 0) {
+      if (errno == EINTR)
+        continue;
+      llvm::errs() << "error: accept: " << strerror(errno) << "\n";
+      Failed = true;
+      break;
+    }
+    if (Server.Stopping) {
+      close(FD);
+      break;
+    }
+    Connection *C = new Connection;
+    C->Server = &Server;
+    C->FD = FD;
+    llvm::sys::AtomicIncrement(&Server.ActiveRequests);
+    pthread_t Thread;
+    if (pthread_create(&Thread, &Attributes, &serveConnection, C) != 0)
+      serveConnection(C);
+  }
+  pthread_attr_destroy(&Attributes);
+
+  close(Listener);
+  unlink(ServePath.c_str());
+  // Let requests already being served finish
+  while (Server.ActiveRequests)
+    usleep(10000);
+  return Failed ? 1 : 0;
+}
+
+
+static std::string defaultPluginPath(const char *Argv0) {
+  std::string Executable = llvm::sys::fs::getMainExecutable(Argv0, (void *)(intptr_t)&defaultPluginPath);
+  SmallString<256> Path(llvm::sys::path::parent_path(llvm::sys::path::parent_path(Executable)));
+#ifdef __APPLE__
+  llvm::sys::path::append(Path, "lib", "libKeyPathValidator.dylib");
+#else
+  llvm::sys::path::append(Path, "lib", "libKeyPathValidator.so");
+#endif
+  return Path.str();
+}
+
+
+int main(int argc, const char **argv) {
+  llvm::sys::PrintStackTraceOnErrorSignal();
+  llvm::cl::ParseCommandLineOptions(argc, argv, "validate literal key paths in every file of a compilation database\n");
+
+  std::string Error;
+  std::string Plugin = PluginPath.empty() ? defaultPluginPath(argv[0]) : PluginPath;
+  if (llvm::sys::DynamicLibrary::LoadLibraryPermanently(Plugin.c_str(), &Error)) {
+    llvm::errs() << "error: can't load plug-in: " << Error << "\n";
+    return 1;
+  }
+
+  ToolState State;
+  State.Plugin = NULL;
+  for (FrontendPluginRegistry::iterator Entry = FrontendPluginRegistry::begin(), EntryEnd = FrontendPluginRegistry::end();
+      Entry != EntryEnd; ++Entry)
+    if (StringRef(Entry->getName()) == "validate-key-paths")
+      State.Plugin = &*Entry;
+  if (!State.Plugin) {
+    llvm::errs() << "error: " << Plugin << " doesn't register validate-key-paths\n";
+    return 1;
+  }
+  State.PluginArgs.assign(PluginArgs.begin(), PluginArgs.end());
+
+  if (!ServePath.empty())
+    return serve(State);
+
+  OwningPtr<CompilationDatabase> Compilations(CompilationDatabase::loadFromDirectory(BuildPath, Error));
+  if (!Compilations) {
+    llvm::errs() << "error: " << Error << "\n";
+    return 1;
+  }
+
+  std::vector<std::string> Files;
+  if (SourcePaths.empty())
+    Files = Compilations->getAllFiles();
+  for (unsigned I = 0, E = SourcePaths.size(); I != E; ++I) {
+    SmallString<256> Path(SourcePaths[I]);
+    llvm::sys::fs::make_absolute(Path);
+    Files.push_back(Path.str());
+  }
+
+  for (std::vector<std::string>::const_iterator File = Files.begin(), FileEnd = Files.end();
+      File != FileEnd; ++File) {
+    std::vector<CompileCommand> Commands = Compilations->getCompileCommands(*File);
+    if (Commands.empty())
+      llvm::errs() << "warning: no compile command for " << *File << "\n";
+    for (std::vector<CompileCommand>::const_iterator Command = Commands.begin(), CommandEnd = Commands.end();
+        Command != CommandEnd; ++Command) {
+      State.Jobs.push_back(ValidationJob());
+      State.Jobs.back().Command = *Command;
+      State.Jobs.back().Succeeded = false;
+    }
+  }
+
+  unsigned Threads = NumThreads;
+  if (Threads == 0) {
+    long CPUs = sysconf(_SC_NPROCESSORS_ONLN);
+    Threads = CPUs > 0 ? CPUs : 1;
+  }
+  if (!llvm::llvm_start_multithreaded())
+    Threads = 1;
+  WorkStealingPool::run(State.Jobs.size(), Threads, &runJob, &State);
+
+  // Shared headers are seen by many TUs; report each diagnostic once
+  std::vector<Finding> Merged;
+  bool Failed = false;
+  for (std::vector<ValidationJob>::const_iterator Job = State.Jobs.begin(), JobEnd = State.Jobs.end();
+      Job != JobEnd; ++Job) {
+    Merged.insert(Merged.end(), Job->Findings.begin(), Job->Findings.end());
+    Failed |= !Job->Succeeded;
+  }
+  printFindings(Merged, llvm::outs());
+
+  return Failed ? 1 : 0;
+}
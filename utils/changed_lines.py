@@ -0,0 +1,66 @@
+#!/usr/bin/env python
+#
+# changed_lines.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Writes the lines changed since a base revision, in the form read by
+# -plugin-arg-validate-key-paths changed-lines=<file>:
+#
+#   <absolute path>:<first>-<last>
+#
+# For a pull request, run it against the merge base:
+#
+#   changed_lines.py --base $(git merge-base origin/master HEAD) > changed.txt
+#
+# Lines are those of the working tree. Where lines were only removed, the
+# lines on either side count as changed, so the function they were removed
+# from is still checked.
+#
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+
+
+HUNK = re.compile(r'^@@ -\d+(?:,\d+)? \+(\d+)(?:,(\d+))? @@')
+
+
+def changed_ranges(diff):
+    path = None
+    for line in diff.splitlines():
+        if line.startswith('+++ '):
+            # git ends names containing spaces with a tab
+            target = line[4:].rstrip('\t')
+            path = None if target == '/dev/null' else target[2:] if target.startswith('b/') else target
+        elif path is not None:
+            match = HUNK.match(line)
+            if not match:
+                continue
+            start = int(match.group(1))
+            count = int(match.group(2)) if match.group(2) is not None else 1
+            if count:
+                yield path, start, start + count - 1
+            else:
+                # Lines removed after line <start>
+                yield path, max(start, 1), start + 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description='List changed line ranges for validate-key-paths changed-lines=.')
+    parser.add_argument('--base', default='HEAD', help='revision to diff the working tree against (default: HEAD)')
+    parser.add_argument('paths', nargs='*', help='limit the diff to these paths')
+    options = parser.parse_args()
+
+    root = subprocess.check_output(['git', 'rev-parse', '--show-toplevel']).decode('utf-8').strip()
+    diff = subprocess.check_output(['git', '-c', 'core.quotepath=off', 'diff', '-U0', '--no-color', '--no-ext-diff', options.base, '--'] + options.paths,
+                                   cwd=root).decode('utf-8', 'replace')
+    for path, first, last in changed_ranges(diff):
+        sys.stdout.write('%s:%d-%d\n' % (os.path.join(root, path), first, last))
+
+
+if __name__ == '__main__':
+    main()
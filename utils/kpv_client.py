@@ -0,0 +1,63 @@
+#!/usr/bin/env python
+#
+# kpv_client.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Sends a compile command to validate-key-paths -serve <socket> and prints
+# its findings, exiting with the status of the validation:
+#
+#   kpv_client.py --socket /tmp/kpv.sock -- clang -fobjc-arc -c Foo.m -o Foo.o
+#
+# --stop asks the server to exit.
+#
+
+import argparse
+import os
+import socket
+import sys
+
+
+def request(socket_path, directory, command_line):
+    connection = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+    connection.connect(socket_path)
+    fields = [str(len(command_line)), directory] + command_line
+    connection.sendall(b''.join(field.encode('utf-8') + b'\0' for field in fields))
+
+    chunks = []
+    while True:
+        chunk = connection.recv(65536)
+        if not chunk:
+            break
+        chunks.append(chunk)
+    connection.close()
+    return b''.join(chunks).decode('utf-8', 'replace')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Validate key paths in one file using a running validate-key-paths -serve.')
+    parser.add_argument('--socket', required=True, help='path given to -serve')
+    parser.add_argument('--stop', action='store_true', help='stop the server')
+    parser.add_argument('command', nargs=argparse.REMAINDER, help='-- compile command')
+    options = parser.parse_args()
+
+    command_line = options.command
+    if command_line and command_line[0] == '--':
+        command_line = command_line[1:]
+    if not command_line and not options.stop:
+        parser.error('expected a compile command after --')
+
+    reply = request(options.socket, os.getcwd(), [] if options.stop else command_line)
+    lines = reply.splitlines()
+    if not lines or not lines[-1].startswith('exit '):
+        sys.stderr.write('error: incomplete reply from %s\n' % options.socket)
+        return 1
+    # Like clang, so editors and Xcode pick the warnings up
+    for line in lines[:-1]:
+        sys.stderr.write(line + '\n')
+    return int(lines[-1].split()[1])
+
+
+if __name__ == '__main__':
+    sys.exit(main())
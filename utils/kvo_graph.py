@@ -0,0 +1,147 @@
+#!/usr/bin/env python
+#
+# kvo_graph.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Merges the KVO dependency graphs written by -plugin-arg-validate-key-paths
+# kvo-graph from every translation unit, then ranks keys by how many other
+# keys KVO notifies, transitively, when they change. A class's
+# +keyPathsForValuesAffecting<Key> methods are all in its @implementation,
+# but the keys they depend on can belong to classes implemented elsewhere,
+# so fan-out and cycles are only complete across the whole app.
+#
+
+import argparse
+import json
+import sys
+
+
+def load(paths):
+    # affected node -> {key path: dependency}
+    dependencies = {}
+    for path in paths:
+        with open(path) as f:
+            graph = json.load(f)
+        for cls in graph['classes']:
+            for key in cls['keys']:
+                node = '%s.%s' % (cls['class'], key['key'])
+                merged = dependencies.setdefault(node, {})
+                for dependency in key['depends_on']:
+                    merged.setdefault(dependency['key_path'], dependency)
+    return dependencies
+
+
+def build_edges(dependencies):
+    edges = {}
+    for affected, by_key_path in dependencies.items():
+        edges.setdefault(affected, set())
+        for dependency in by_key_path.values():
+            for trigger in dependency['via']:
+                edges.setdefault(trigger, set()).add(affected)
+    return edges
+
+
+def reachable(edges, start):
+    seen = set([start])
+    found = set()
+    work = [start]
+    while work:
+        for following in edges[work.pop()]:
+            if following not in seen:
+                seen.add(following)
+                found.add(following)
+                work.append(following)
+    return found
+
+
+def cycles(edges):
+    # Tarjan's algorithm, iteratively
+    index = {}
+    low = {}
+    on_stack = set()
+    stack = []
+    result = []
+    counter = [0]
+    for root in sorted(edges):
+        if root in index:
+            continue
+        work = [(root, iter(sorted(edges[root])))]
+        index[root] = low[root] = counter[0]
+        counter[0] += 1
+        stack.append(root)
+        on_stack.add(root)
+        while work:
+            node, children = work[-1]
+            advanced = False
+            for child in children:
+                if child not in index:
+                    index[child] = low[child] = counter[0]
+                    counter[0] += 1
+                    stack.append(child)
+                    on_stack.add(child)
+                    work.append((child, iter(sorted(edges[child]))))
+                    advanced = True
+                    break
+                elif child in on_stack:
+                    low[node] = min(low[node], index[child])
+            if advanced:
+                continue
+            work.pop()
+            if work:
+                low[work[-1][0]] = min(low[work[-1][0]], low[node])
+            if low[node] == index[node]:
+                component = []
+                while True:
+                    member = stack.pop()
+                    on_stack.discard(member)
+                    component.append(member)
+                    if member == node:
+                        break
+                if len(component) > 1 or node in edges[node]:
+                    result.append(sorted(component))
+    return sorted(result)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge validate-key-paths KVO graphs and rank keys by fan-out.')
+    parser.add_argument('inputs', nargs='+', help='.kvograph.json files')
+    parser.add_argument('--top', type=int, default=20, help='keys to list (default: 20)')
+    parser.add_argument('--json', action='store_true', help='write the merged analysis as JSON')
+    options = parser.parse_args()
+
+    dependencies = load(options.inputs)
+    edges = build_edges(dependencies)
+    fan_out = dict((node, sorted(reachable(edges, node))) for node in edges)
+    ranked = sorted(edges, key=lambda node: (-len(fan_out[node]), node))
+    found_cycles = cycles(edges)
+    to_many = sorted((affected, key_path)
+                     for affected, by_key_path in dependencies.items()
+                     for key_path, dependency in by_key_path.items() if dependency['to_many'])
+
+    if options.json:
+        json.dump({
+            'fan_out': [{'key': node, 'fan_out': len(fan_out[node]), 'triggers': fan_out[node]} for node in ranked],
+            'cycles': found_cycles,
+            'to_many': [{'key': affected, 'key_path': key_path} for affected, key_path in to_many],
+        }, sys.stdout, indent=2, sort_keys=True)
+        sys.stdout.write('\n')
+        return
+
+    sys.stdout.write('Keys by fan-out:\n')
+    for node in ranked[:options.top]:
+        if fan_out[node]:
+            sys.stdout.write('  %5d  %s\n' % (len(fan_out[node]), node))
+    if found_cycles:
+        sys.stdout.write('Cycles:\n')
+        for component in found_cycles:
+            sys.stdout.write('  %s\n' % ' <-> '.join(component))
+    if to_many:
+        sys.stdout.write('Dependencies through to-many relationships:\n')
+        for affected, key_path in to_many:
+            sys.stdout.write('  %s depends on %s\n' % (affected, key_path))
+
+
+if __name__ == '__main__':
+    main()
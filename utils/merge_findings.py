@@ -0,0 +1,115 @@
+#!/usr/bin/env python
+#
+# merge_findings.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Merges the findings files written by -plugin-arg-validate-key-paths
+# findings (JSON Lines or SARIF, in any mix) from many translation units or
+# CI shards into one, keeping a single copy of each fingerprint. Findings in
+# a header included by many translation units appear once. Output is sorted
+# by file and position, so merged results can be diffed.
+#
+
+import argparse
+import json
+import sys
+
+
+# JSON Lines field names, and the SARIF result properties they come from
+PROPERTY_FIELDS = [
+    ('check', 'check'),
+    ('selector', 'selector'),
+    ('key_path', 'keyPath'),
+    ('key', 'key'),
+    ('key_offset', 'keyOffset'),
+    ('receiver_type', 'receiverType'),
+    ('container', 'container'),
+]
+
+RULES = [
+    {'id': 'invalid-key', 'shortDescription': {'text': "Key not found on the type it's looked up on"}},
+    {'id': 'to-many-key-path', 'shortDescription': {'text': 'Key path evaluated for every element of a to-many relationship'}},
+    {'id': 'kvc-in-loop', 'shortDescription': {'text': 'Keys looked up by name on every iteration of a loop'}},
+    {'id': 'affecting-key-path', 'shortDescription': {'text': 'Key path returned by +keyPathsForValuesAffecting<Key>'}},
+]
+
+
+def findings_from_sarif(log):
+    for run in log.get('runs', []):
+        for result in run.get('results', []):
+            location = result['locations'][0]['physicalLocation']
+            properties = result.get('properties', {})
+            finding = {
+                'kind': result['ruleId'],
+                'file': location['artifactLocation']['uri'],
+                'line': location['region']['startLine'],
+                'column': location['region']['startColumn'],
+                'message': result['message']['text'],
+                'fingerprint': result['partialFingerprints']['validateKeyPaths/v2'],
+            }
+            for field, name in PROPERTY_FIELDS:
+                finding[field] = properties.get(name, '' if field != 'key_offset' else 0)
+            yield finding
+
+
+def read_findings(path):
+    with open(path) as f:
+        text = f.read()
+    try:
+        document = json.loads(text)
+    except ValueError:
+        document = None  # several JSON Lines
+    if isinstance(document, dict) and 'runs' in document:
+        return list(findings_from_sarif(document))
+    return [json.loads(line) for line in text.splitlines() if line.strip()]
+
+
+def to_sarif(findings):
+    results = []
+    for finding in findings:
+        results.append({
+            'ruleId': finding['kind'],
+            'level': 'note' if finding['kind'] == 'affecting-key-path' else 'warning',
+            'message': {'text': finding['message']},
+            'locations': [{'physicalLocation': {
+                'artifactLocation': {'uri': finding['file']},
+                'region': {'startLine': finding['line'], 'startColumn': finding['column']},
+            }}],
+            'partialFingerprints': {'validateKeyPaths/v2': finding['fingerprint']},
+            'properties': dict((name, finding.get(field, '')) for field, name in PROPERTY_FIELDS),
+        })
+    return {
+        '$schema': 'https://json.schemastore.org/sarif-2.1.0.json',
+        'version': '2.1.0',
+        'runs': [{'tool': {'driver': {'name': 'validate-key-paths', 'rules': RULES}}, 'results': results}],
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge validate-key-paths findings files, dropping duplicates.')
+    parser.add_argument('inputs', nargs='+', help='.jsonl or .sarif findings files')
+    parser.add_argument('--format', choices=['jsonl', 'sarif'], default='jsonl')
+    parser.add_argument('--output', help='write here rather than stdout')
+    options = parser.parse_args()
+
+    merged = {}
+    for path in options.inputs:
+        for finding in read_findings(path):
+            merged.setdefault(finding['fingerprint'], finding)
+    findings = sorted(merged.values(), key=lambda f: (f['file'], f['line'], f['column'], f['kind'], f['fingerprint']))
+
+    if options.format == 'sarif':
+        output = json.dumps(to_sarif(findings), indent=2, sort_keys=True) + '\n'
+    else:
+        output = ''.join(json.dumps(f, sort_keys=True) + '\n' for f in findings)
+    if options.output:
+        with open(options.output, 'w') as f:
+            f.write(output)
+    else:
+        sys.stdout.write(output)
+
+
+if __name__ == '__main__':
+    main()
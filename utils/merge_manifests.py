@@ -0,0 +1,133 @@
+#!/usr/bin/env python
+#
+# merge_manifests.py
+#
+# This file is distributed under the University of Illinois Open Source
+# License. See LICENSE.TXT for details.
+#
+# Merges the key path manifests written by -plugin-arg-validate-key-paths
+# manifest for each translation unit into one for the app, in the same
+# format (see KeyPathManifest.h), keeping one copy of each key path:
+#
+#   merge_manifests.py --output App.kpvmanifest build/*.o.kpvmanifest
+#
+# --list prints the merged key paths instead, one per line.
+#
+
+import argparse
+import struct
+import sys
+
+
+MAGIC = b'KPVM'
+VERSION = 1
+
+# KVCAccessorTable::AccessorKind
+ACCESSOR_KINDS = ['getKey', 'key', 'isKey', 'ordered-collection', 'unordered-collection',
+                  'collection-property', 'ivar', 'none']
+
+
+class ManifestError(Exception):
+    pass
+
+
+def read_manifest(path):
+    with open(path, 'rb') as f:
+        data = f.read()
+    header = struct.Struct('<4s5I')
+    if len(data) < header.size:
+        raise ManifestError('%s: not a key path manifest' % path)
+    magic, version, num_key_paths, num_steps, num_path_steps, strings_size = header.unpack_from(data)
+    if magic != MAGIC or version != VERSION:
+        raise ManifestError('%s: not a version %d key path manifest' % (path, VERSION))
+    expected = header.size + 4 * (5 * num_key_paths + 3 * num_steps + num_path_steps) + strings_size
+    if len(data) != expected or strings_size == 0 or data[-1:] != b'\0':
+        raise ManifestError('%s: truncated or corrupt' % path)
+
+    offset = header.size
+    key_paths = struct.unpack_from('<%dI' % (5 * num_key_paths), data, offset)
+    offset += 20 * num_key_paths
+    steps = struct.unpack_from('<%dI' % (3 * num_steps), data, offset)
+    offset += 12 * num_steps
+    path_steps = struct.unpack_from('<%dI' % num_path_steps, data, offset)
+    offset += 4 * num_path_steps
+    strings = data[offset:]
+
+    def string(string_offset):
+        if string_offset >= strings_size:
+            raise ManifestError('%s: string offset out of range' % path)
+        return strings[string_offset:strings.index(b'\0', string_offset)].decode('utf-8')
+
+    decoded_steps = [(string(steps[i]), string(steps[i + 1]), steps[i + 2]) for i in range(0, len(steps), 3)]
+    for i in range(0, len(key_paths), 5):
+        klass, key_path, affected_key, first, count = key_paths[i:i + 5]
+        if first + count > num_path_steps or any(s >= num_steps for s in path_steps[first:first + count]):
+            raise ManifestError('%s: step index out of range' % path)
+        yield (string(klass), string(key_path), string(affected_key)), [decoded_steps[s] for s in path_steps[first:first + count]]
+
+
+def write_manifest(key_paths):
+    strings = bytearray(b'\0')
+    offsets = {'': 0}
+
+    def add_string(s):
+        if s not in offsets:
+            offsets[s] = len(strings)
+            strings.extend(s.encode('utf-8') + b'\0')
+        return offsets[s]
+
+    # As KeyPathManifestWriter::write orders them
+    step_indexes = {}
+    for steps in key_paths.values():
+        for klass, key, kind in steps:
+            step_indexes.setdefault((klass, key), kind)
+    step_order = sorted(step_indexes)
+    step_numbers = dict((step, i) for i, step in enumerate(step_order))
+
+    key_path_records, path_steps = [], []
+    for name in sorted(key_paths):
+        steps = key_paths[name]
+        key_path_records.extend([add_string(name[0]), add_string(name[1]), add_string(name[2]), len(path_steps), len(steps)])
+        path_steps.extend(step_numbers[(klass, key)] for klass, key, kind in steps)
+    step_records = []
+    for klass, key in step_order:
+        step_records.extend([add_string(klass), add_string(key), step_indexes[(klass, key)]])
+
+    output = struct.pack('<4s5I', MAGIC, VERSION, len(key_paths), len(step_order), len(path_steps), len(strings))
+    for records in (key_path_records, step_records, path_steps):
+        output += struct.pack('<%dI' % len(records), *records)
+    return output + bytes(strings)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Merge validate-key-paths key path manifests.')
+    parser.add_argument('inputs', nargs='+', help='.kpvmanifest files')
+    parser.add_argument('--output', help='write the merged manifest here')
+    parser.add_argument('--list', action='store_true', help='print the merged key paths')
+    options = parser.parse_args()
+    if not options.output and not options.list:
+        parser.error('expected --output or --list')
+
+    merged = {}
+    try:
+        for path in options.inputs:
+            for name, steps in read_manifest(path):
+                merged.setdefault(name, steps)
+    except (IOError, ManifestError) as e:
+        sys.stderr.write('error: %s\n' % e)
+        return 1
+
+    if options.list:
+        for klass, key_path, affected_key in sorted(merged):
+            steps = ' '.join('%s.%s=%s' % (step[0], step[1], ACCESSOR_KINDS[step[2]] if step[2] < len(ACCESSOR_KINDS) else step[2])
+                             for step in merged[(klass, key_path, affected_key)])
+            affects = ' affects %s' % affected_key if affected_key else ''
+            sys.stdout.write('%s %s%s: %s\n' % (klass, key_path, affects, steps))
+    if options.output:
+        with open(options.output, 'wb') as f:
+            f.write(write_manifest(merged))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())